@@ -0,0 +1,494 @@
+#include <assert.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../mem.h"
+
+/**
+ * Mesure de la vitesse et de la fragmentation des stratégies de mem.c, comparées au malloc de la glibc.
+ *
+ * Chaque charge de travail est d'abord convertie en une suite d'opérations (allocation, libération, réallocation
+ * d'un identifiant), puis cette même suite est rejouée sur chaque allocateur. Une trace enregistrée est chargée de la
+ * même manière, dans un format texte d'une opération par ligne :
+ *
+ *     a <id> <taille>     allocation de <taille> octets, référencée ensuite par <id>
+ *     r <id> <taille>     réallocation de <id>
+ *     f <id>              libération de <id>
+ *
+ * Les lignes vides et celles qui commencent par # sont ignorées.
+ *
+ * Chaque mesure tourne dans un processus fils, pour que les allocateurs partent tous d'un état vierge. Les tableaux du
+ * banc lui-même sont projetés avec mmap et ne faussent donc pas la mesure de la glibc.
+ */
+
+#define DEFAULT_OPS 200000
+#define SAMPLE_PERIOD 256 // nombre d'opérations entre deux relevés de l'occupation du tas
+
+enum op_kind { OP_ALLOC, OP_FREE, OP_REALLOC };
+
+struct op {
+    uint32_t kind;
+    uint32_t id;
+    size_t size;
+};
+
+struct workload {
+    const char *name;
+    struct op *ops;
+    size_t nb_ops;
+    size_t capacity;
+    size_t nb_ids;
+};
+
+/* Allocateurs comparés */
+
+struct allocator {
+    const char *name;
+    mem_fit_function_t *fit; // NULL pour la glibc
+    bool deferred;           // libérations différées (mem_heap_defer_frees)
+};
+
+#define DEFER_BUDGET (64 * 1024)
+
+static const struct allocator allocators[] = {
+    {"first", mem_fit_first, false},
+    {"next", mem_fit_next, false},
+    {"best", mem_fit_best, false},
+    {"worst", mem_fit_worst, false},
+    {"segregated", mem_fit_segregated, false},
+    {"best_tree", mem_fit_best_tree, false},
+    {"worst_tree", mem_fit_worst_tree, false},
+    {"first_defer", mem_fit_first, true},
+    {"seg_defer", mem_fit_segregated, true},
+    {"glibc", NULL, false},
+};
+#define NB_ALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+static struct mem_heap *heap;
+
+static void *bench_alloc(const struct allocator *a, size_t size) {
+    return a->fit ? mem_heap_alloc(heap, size) : malloc(size);
+}
+
+static void bench_free(const struct allocator *a, void *ptr) {
+    if (a->fit) {
+        mem_heap_free(heap, ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+static void *bench_realloc(const struct allocator *a, void *ptr, size_t size) {
+    return a->fit ? mem_heap_realloc(heap, ptr, size) : realloc(ptr, size);
+}
+
+/* Mémoire demandée au système par l'allocateur */
+static size_t footprint(const struct allocator *a) {
+    if (a->fit) {
+        return mem_heap_memory_size(heap);
+    }
+    struct mallinfo2 info = mallinfo2();
+    return info.arena + info.hblkhd;
+}
+
+/* Tableaux du banc, hors des allocateurs mesurés */
+
+static void *map(size_t size) {
+    void *p = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return p;
+}
+
+static void unmap(void *p, size_t size) {
+    munmap(p, size ? size : 1);
+}
+
+static void push(struct workload *w, enum op_kind kind, uint32_t id, size_t size) {
+    if (w->nb_ops == w->capacity) {
+        size_t capacity = w->capacity ? w->capacity * 2 : 4096;
+        struct op *ops = map(capacity * sizeof(struct op));
+        if (w->ops) {
+            memcpy(ops, w->ops, w->nb_ops * sizeof(struct op));
+            unmap(w->ops, w->capacity * sizeof(struct op));
+        }
+        w->ops = ops;
+        w->capacity = capacity;
+    }
+    struct op *op = &w->ops[w->nb_ops++];
+    op->kind = kind;
+    op->id = id;
+    op->size = size;
+    if (id >= w->nb_ids) {
+        w->nb_ids = id + 1;
+    }
+}
+
+/* Charges synthétiques */
+
+// Taille répartie uniformément en échelle logarithmique entre 16 et 8192 octets : beaucoup de petites zones, quelques
+// grandes
+static size_t random_size(unsigned *seed) {
+    int log = 4 + rand_r(seed) % 9;
+    return ((size_t) 1 << log) + rand_r(seed) % ((size_t) 1 << log);
+}
+
+static void fixed_churn(struct workload *w, size_t nb_ops) {
+    const uint32_t slots = 1000;
+    unsigned seed = 1;
+    bool live[1000] = {0};
+    while (w->nb_ops < nb_ops) {
+        uint32_t id = rand_r(&seed) % slots;
+        push(w, live[id] ? OP_FREE : OP_ALLOC, id, 64);
+        live[id] = !live[id];
+    }
+}
+
+static void random_sizes(struct workload *w, size_t nb_ops) {
+    const uint32_t slots = 1000;
+    unsigned seed = 2;
+    bool live[1000] = {0};
+    while (w->nb_ops < nb_ops) {
+        uint32_t id = rand_r(&seed) % slots;
+        push(w, live[id] ? OP_FREE : OP_ALLOC, id, random_size(&seed));
+        live[id] = !live[id];
+    }
+}
+
+// Les zones sont libérées dans l'ordre où elles ont été allouées, comme des messages passant par une file
+static void producer_consumer(struct workload *w, size_t nb_ops) {
+    const uint32_t queue = 500;
+    unsigned seed = 3;
+    uint32_t produced = 0;
+    while (w->nb_ops < nb_ops) {
+        if (produced >= queue) {
+            push(w, OP_FREE, (produced - queue) % queue, 0);
+        }
+        push(w, OP_ALLOC, produced % queue, 32 + rand_r(&seed) % 480);
+        produced++;
+    }
+}
+
+// Des tableaux grandissent de moitié à chaque réallocation jusqu'à 64 Kio, puis sont libérés
+static void realloc_growth(struct workload *w, size_t nb_ops) {
+    const uint32_t vectors = 64;
+    unsigned seed = 4;
+    size_t sizes[64] = {0};
+    while (w->nb_ops < nb_ops) {
+        uint32_t id = rand_r(&seed) % vectors;
+        if (!sizes[id]) {
+            sizes[id] = 16;
+            push(w, OP_ALLOC, id, sizes[id]);
+        } else if (sizes[id] > 64 * 1024) {
+            sizes[id] = 0;
+            push(w, OP_FREE, id, 0);
+        } else {
+            sizes[id] += sizes[id] / 2;
+            push(w, OP_REALLOC, id, sizes[id]);
+        }
+    }
+}
+
+// Des salves de petites allocations, libérées aussitôt après : les mêmes zones sont sans cesse découpées et fusionnées
+static void ping_pong(struct workload *w, size_t nb_ops) {
+    const uint32_t burst = 64;
+    unsigned seed = 5;
+    while (w->nb_ops < nb_ops) {
+        for (uint32_t id = 0; id < burst; id++) {
+            push(w, OP_ALLOC, id, 16 + 16 * (rand_r(&seed) % 16));
+        }
+        for (uint32_t id = 0; id < burst; id++) {
+            push(w, OP_FREE, id, 0);
+        }
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*generate)(struct workload *w, size_t nb_ops);
+} generators[] = {
+    {"fixed_churn", fixed_churn},
+    {"random_sizes", random_sizes},
+    {"producer_consumer", producer_consumer},
+    {"realloc_growth", realloc_growth},
+    {"ping_pong", ping_pong},
+};
+#define NB_GENERATORS (sizeof(generators) / sizeof(generators[0]))
+
+/* Traces enregistrées */
+
+static bool load_trace(struct workload *w, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    unsigned long lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char kind;
+        unsigned long id;
+        size_t size = 0;
+        int n = sscanf(line, " %c %lu %zu", &kind, &id, &size);
+        if (n <= 0 || kind == '#') {
+            continue;
+        }
+        if (n < 2 || id >= UINT32_MAX || (kind != 'f' && n < 3) || !strchr("afr", kind)) {
+            fprintf(stderr, "%s:%lu: ligne invalide\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+        push(w, kind == 'a' ? OP_ALLOC : kind == 'f' ? OP_FREE : OP_REALLOC, (uint32_t) id, size);
+    }
+    fclose(f);
+    return true;
+}
+
+/* Exécution */
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, double p) {
+    return n ? sorted[(size_t) ((double) (n - 1) * p)] : 0;
+}
+
+// Rejoue la charge sur un allocateur et affiche une ligne de résultats. Renvoie faux si l'allocateur a échoué.
+static bool run(const struct workload *w, const struct allocator *a) {
+    if (a->fit) {
+        heap = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS);
+        if (!heap) {
+            fprintf(stderr, "mem_heap_create_mmap a échoué\n");
+            return false;
+        }
+        // Tout passe par la chaîne des fb, c'est elle qu'on mesure
+        mem_heap_large_threshold(heap, 0);
+        mem_heap_fit(heap, a->fit);
+        if (a->deferred) {
+            mem_heap_defer_frees(heap, DEFER_BUDGET);
+        }
+    }
+
+    void **slots = map(w->nb_ids * sizeof(void *));
+    size_t *sizes = map(w->nb_ids * sizeof(size_t));
+    uint32_t *latencies = map(w->nb_ops * sizeof(uint32_t));
+    size_t live = 0, peak_live = 0, peak_heap = footprint(a);
+    bool ok = true;
+
+    double start = now();
+    for (size_t i = 0; i < w->nb_ops && ok; i++) {
+        const struct op *op = &w->ops[i];
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        switch (op->kind) {
+        case OP_ALLOC:
+            if (slots[op->id]) {
+                fprintf(stderr, "opération %zu: %u est déjà alloué\n", i, op->id);
+                ok = false;
+                break;
+            }
+            slots[op->id] = bench_alloc(a, op->size);
+            ok = slots[op->id] || !op->size;
+            break;
+        case OP_REALLOC: {
+            void *p = bench_realloc(a, slots[op->id], op->size);
+            ok = p || !op->size;
+            if (ok) {
+                slots[op->id] = p;
+            }
+            break;
+        }
+        case OP_FREE:
+            bench_free(a, slots[op->id]);
+            slots[op->id] = NULL;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        latencies[i] = (uint32_t) ((t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec));
+
+        if (!ok) {
+            break;
+        }
+        if (op->kind != OP_FREE && slots[op->id] && op->size) {
+            // On touche la zone, comme le ferait le programme qui l'a demandée
+            ((volatile char *) slots[op->id])[op->size - 1] = 1;
+        }
+        live -= sizes[op->id];
+        sizes[op->id] = op->kind == OP_FREE ? 0 : op->size;
+        live += sizes[op->id];
+        if (live > peak_live) {
+            peak_live = live;
+        }
+        if (i % SAMPLE_PERIOD == 0) {
+            size_t used = footprint(a);
+            if (used > peak_heap) {
+                peak_heap = used;
+            }
+        }
+    }
+    double elapsed = now() - start;
+
+    size_t used = footprint(a);
+    if (used > peak_heap) {
+        peak_heap = used;
+    }
+
+    if (ok) {
+        // Découpes et fusions de zones libres pour 100 opérations
+        char churn[16] = "-";
+        if (a->fit) {
+            struct mem_stats stats;
+            mem_heap_stats(heap, &stats);
+            snprintf(churn, sizeof(churn), "%.1f", 100.0 * (double) (stats.splits + stats.merges) / (double) w->nb_ops);
+        }
+        qsort(latencies, w->nb_ops, sizeof(uint32_t), compare_u32);
+        printf("%-18s %-11s %12.0f %7u %7u %7u %8u %10zu %10zu %6.1f%% %8s\n", w->name, a->name,
+               (double) w->nb_ops / elapsed,
+               percentile(latencies, w->nb_ops, 0.5), percentile(latencies, w->nb_ops, 0.9),
+               percentile(latencies, w->nb_ops, 0.99), percentile(latencies, w->nb_ops, 0.999),
+               peak_live / 1024, peak_heap / 1024,
+               peak_heap ? 100.0 * (1.0 - (double) peak_live / (double) peak_heap) : 0.0, churn);
+    } else {
+        printf("%-18s %-11s échec (plus de mémoire ?)\n", w->name, a->name);
+    }
+    fflush(stdout);
+
+    unmap(slots, w->nb_ids * sizeof(void *));
+    unmap(sizes, w->nb_ids * sizeof(size_t));
+    unmap(latencies, w->nb_ops * sizeof(uint32_t));
+    if (a->fit) {
+        mem_heap_destroy(heap);
+    }
+    return ok;
+}
+
+// Chaque mesure dans un processus neuf : la glibc ne garde rien de la mesure précédente
+static bool run_isolated(const struct workload *w, const struct allocator *a) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        _exit(run(w, a) ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status)) {
+        printf("%-18s %-11s terminé anormalement\n", w->name, a->name);
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-n opérations] [-w charge] [-a allocateur] [trace...]\n"
+            "  -n  nombre d'opérations des charges synthétiques (%d par défaut)\n"
+            "  -w  ne lancer que cette charge (plusieurs -w possibles)\n"
+            "  -a  ne mesurer que cet allocateur (plusieurs -a possibles)\n"
+            "Sans -w, toutes les charges synthétiques sont lancées, sauf si des traces sont données.\n"
+            "charges :", name, DEFAULT_OPS);
+    for (size_t i = 0; i < NB_GENERATORS; i++) {
+        fprintf(stderr, " %s", generators[i].name);
+    }
+    fprintf(stderr, "\nallocateurs :");
+    for (size_t i = 0; i < NB_ALLOCATORS; i++) {
+        fprintf(stderr, " %s", allocators[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+    size_t nb_ops = DEFAULT_OPS;
+    bool workload_selected[NB_GENERATORS] = {0}, any_workload = false;
+    bool allocator_selected[NB_ALLOCATORS] = {0}, any_allocator = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:a:h")) != -1) {
+        bool found = false;
+        switch (opt) {
+        case 'n':
+            nb_ops = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            for (size_t i = 0; i < NB_GENERATORS; i++) {
+                if (!strcmp(optarg, generators[i].name)) {
+                    workload_selected[i] = found = any_workload = true;
+                }
+            }
+            if (!found) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'a':
+            for (size_t i = 0; i < NB_ALLOCATORS; i++) {
+                if (!strcmp(optarg, allocators[i].name)) {
+                    allocator_selected[i] = found = any_allocator = true;
+                }
+            }
+            if (!found) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (!any_workload && optind == argc) {
+        memset(workload_selected, 1, sizeof(workload_selected));
+    }
+
+    printf("%-18s %-11s %12s %7s %7s %7s %8s %10s %10s %7s %8s\n", "charge", "allocateur", "ops/s",
+           "p50", "p90", "p99", "p99.9", "vivant", "tas", "frag", "dec+fus");
+    printf("%-18s %-11s %12s %7s %7s %7s %8s %10s %10s %7s %8s\n", "", "", "", "ns", "ns", "ns", "ns", "Kio", "Kio", "",
+           "%");
+
+    bool ok = true;
+    for (size_t i = 0; i < NB_GENERATORS + (size_t) (argc - optind); i++) {
+        struct workload w = {0};
+        if (i < NB_GENERATORS) {
+            if (!workload_selected[i]) {
+                continue;
+            }
+            w.name = generators[i].name;
+            generators[i].generate(&w, nb_ops);
+        } else {
+            const char *path = argv[optind + i - NB_GENERATORS];
+            const char *slash = strrchr(path, '/');
+            w.name = slash ? slash + 1 : path;
+            if (!load_trace(&w, path)) {
+                ok = false;
+                continue;
+            }
+        }
+        for (size_t j = 0; j < NB_ALLOCATORS; j++) {
+            if (!any_allocator || allocator_selected[j]) {
+                ok &= run_isolated(&w, &allocators[j]);
+            }
+        }
+        if (w.ops) {
+            unmap(w.ops, w.capacity * sizeof(struct op));
+        }
+    }
+    return ok ? 0 : 1;
+}
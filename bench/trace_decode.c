@@ -0,0 +1,213 @@
+#include <search.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../trace.h"
+
+/**
+ * Décodeur des traces binaires de malloc_stub.c (voir trace.h).
+ *
+ * Par défaut, la trace est convertie au format texte rejoué par bench/bench : les enregistrements sont remis dans
+ * l'ordre chronologique et chaque zone reçoit un identifiant, recyclé après sa libération. Les libérations de zones
+ * allouées avant le début de la trace sont ignorées. Avec -r, les enregistrements sont affichés tels quels, un par
+ * ligne.
+ */
+
+static const char *op_names[] = {"malloc", "calloc", "realloc", "free"};
+
+static struct trace_record *records;
+static size_t nb_records;
+
+/* Zones vivantes : adresse -> identifiant */
+
+struct live {
+    uint64_t ptr;
+    uint32_t id;
+};
+
+static void *live_root;
+static uint32_t *free_ids;
+static size_t nb_free_ids;
+static uint32_t next_id;
+
+static int compare_live(const void *a, const void *b) {
+    uint64_t x = ((const struct live *) a)->ptr, y = ((const struct live *) b)->ptr;
+    return (x > y) - (x < y);
+}
+
+static struct live *live_find(uint64_t ptr) {
+    struct live key = {ptr, 0};
+    struct live **found = tfind(&key, &live_root, compare_live);
+    return found ? *found : NULL;
+}
+
+static uint32_t live_add(uint64_t ptr) {
+    struct live *l = malloc(sizeof(*l));
+    if (!l) {
+        perror("malloc");
+        exit(1);
+    }
+    l->ptr = ptr;
+    l->id = nb_free_ids ? free_ids[--nb_free_ids] : next_id++;
+    tsearch(l, &live_root, compare_live);
+    return l->id;
+}
+
+static void live_remove(struct live *l) {
+    tdelete(l, &live_root, compare_live);
+    free_ids[nb_free_ids++] = l->id;
+    free(l);
+}
+
+// Une adresse renvoyée par realloc alors qu'elle est encore vivante : un realloc est daté de son début, et un autre
+// thread a libéré l'adresse pendant l'appel. On place la libération juste avant.
+static void release_reused(uint64_t ptr) {
+    struct live *l = live_find(ptr);
+    if (l) {
+        printf("f %u\n", l->id);
+        live_remove(l);
+    }
+}
+
+static void replay(const struct trace_record *r, size_t *skipped) {
+    struct live *l;
+    switch (r->op) {
+    case TRACE_MALLOC:
+    case TRACE_CALLOC:
+        if (r->ptr) {
+            printf("a %u %llu\n", live_add(r->ptr), (unsigned long long) r->size);
+        }
+        break;
+    case TRACE_REALLOC:
+        l = r->old ? live_find(r->old) : NULL;
+        if (!l) {
+            // realloc(NULL), ou d'une zone allouée avant la trace : c'est une allocation
+            if (r->old)
+                (*skipped)++;
+            if (r->ptr) {
+                release_reused(r->ptr);
+                printf("a %u %llu\n", live_add(r->ptr), (unsigned long long) r->size);
+            }
+        } else if (!r->ptr) {
+            // Échec, ou realloc(ptr, 0) qui libère la zone
+            if (!r->size) {
+                printf("r %u 0\n", l->id);
+                live_remove(l);
+            }
+        } else {
+            if (r->ptr != r->old)
+                release_reused(r->ptr);
+            printf("r %u %llu\n", l->id, (unsigned long long) r->size);
+            // L'adresse est la clé de l'arbre : on réinsère
+            tdelete(l, &live_root, compare_live);
+            l->ptr = r->ptr;
+            tsearch(l, &live_root, compare_live);
+        }
+        break;
+    case TRACE_FREE:
+        l = live_find(r->ptr);
+        if (l) {
+            printf("f %u\n", l->id);
+            live_remove(l);
+        } else {
+            (*skipped)++;
+        }
+        break;
+    }
+}
+
+// Tri d'indices : à date égale, les enregistrements gardent leur ordre dans le fichier, donc celui de leur thread
+static int compare_time(const void *a, const void *b) {
+    size_t i = *(const size_t *) a, j = *(const size_t *) b;
+    if (records[i].time != records[j].time)
+        return (records[i].time > records[j].time) - (records[i].time < records[j].time);
+    return (i > j) - (i < j);
+}
+
+static bool load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    struct trace_file_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))
+        || header.version != TRACE_VERSION || header.record_size != sizeof(struct trace_record)) {
+        fprintf(stderr, "%s: ce n'est pas une trace de version %d\n", path, TRACE_VERSION);
+        fclose(f);
+        return false;
+    }
+    size_t capacity = 0;
+    for (;;) {
+        if (nb_records == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            records = realloc(records, capacity * sizeof(struct trace_record));
+            if (!records) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        size_t n = fread(records + nb_records, sizeof(struct trace_record), capacity - nb_records, f);
+        nb_records += n;
+        if (n == 0)
+            break;
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bool raw = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        if (opt == 'r') {
+            raw = true;
+        } else {
+            fprintf(stderr, "usage: %s [-r] trace\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-r] trace\n", argv[0]);
+        return 2;
+    }
+    if (!load(argv[optind]))
+        return 1;
+
+    size_t *order = malloc((nb_records + 1) * sizeof(size_t));
+    if (!order) {
+        perror("malloc");
+        return 1;
+    }
+    for (size_t i = 0; i < nb_records; i++)
+        order[i] = i;
+    qsort(order, nb_records, sizeof(size_t), compare_time);
+
+    if (raw) {
+        printf("# date thread opération zone ancienne taille appelant\n");
+        for (size_t i = 0; i < nb_records; i++) {
+            const struct trace_record *r = &records[order[i]];
+            printf("%llu %u %s %#llx %#llx %llu %08x\n", (unsigned long long) r->time, r->thread,
+                   r->op < sizeof(op_names) / sizeof(op_names[0]) ? op_names[r->op] : "?",
+                   (unsigned long long) r->ptr, (unsigned long long) r->old, (unsigned long long) r->size,
+                   r->callsite);
+        }
+        return 0;
+    }
+
+    free_ids = malloc((nb_records + 1) * sizeof(uint32_t));
+    if (!free_ids) {
+        perror("malloc");
+        return 1;
+    }
+    size_t skipped = 0;
+    printf("# %s : %zu opérations\n", argv[optind], nb_records);
+    for (size_t i = 0; i < nb_records; i++)
+        replay(&records[order[i]], &skipped);
+    if (skipped)
+        fprintf(stderr, "%zu opérations sur des zones allouées avant la trace ignorées\n", skipped);
+    return 0;
+}
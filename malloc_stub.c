@@ -1,7 +1,20 @@
 #include "mem.h"
 #include "common.h"
+#include "mem_profile.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
 static __thread int in_lib=0;
 
@@ -14,78 +27,625 @@ static __thread int in_lib=0;
 	}					\
     } while (0)
 
-static
-void init() {
-    static int first=1;
+/* Le tas est partagé par tous les threads : toute opération sur celui-ci se fait sous ce verrou.
+ * Les petites zones libérées passent d'abord par un cache propre à chaque thread (voir plus bas), qui évite de prendre
+ * le verrou dans le cas courant.
+ */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    if (first) {
-        mem_init(get_memory_adr(), get_memory_size(), false);
-        first = 0;
+static void lock() {
+    static bool initialized = false;
+
+    pthread_mutex_lock(&heap_lock);
+    if (!initialized) {
+        // Les boundary tags permettent de connaître la taille d'une zone sans parcourir le tas, donc sans verrou
+        // Le tas grandit à la demande ; à défaut de pouvoir réserver de l'espace d'adressage, on se contente de la
+        // zone statique de common.c
+        if (!mem_init_mmap(0, MEM_BOUNDARY_TAGS | MEM_SLABS))
+            mem_init_flags(get_memory_adr(), get_memory_size(), MEM_BOUNDARY_TAGS | MEM_SLABS);
+        initialized = true;
     }
 }
 
-void* malloc_info3 = &malloc;
-void *malloc(size_t s) {
+static void unlock() {
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/* Cache par thread des petites zones
+ *
+ * Une classe par multiple de 16 octets jusqu'à CACHE_MAX_SIZE. Une zone libérée est gardée (toujours allouée du point
+ * de vue du tas) dans la liste de sa classe, chaînée par son premier mot, et resservie au prochain malloc de la même
+ * classe. Quand une classe dépasse CACHE_CLASS_MAX zones, on en rend la moitié au tas en une seule prise du verrou.
+ */
+#define CACHE_GRANULARITY 16
+#define CACHE_MAX_SIZE 128
+#define CACHE_CLASSES (CACHE_MAX_SIZE / CACHE_GRANULARITY)
+#define CACHE_CLASS_MAX 8
+
+struct cached_zone {
+    struct cached_zone *next;
+};
+
+struct thread_cache {
+    struct cached_zone *zones[CACHE_CLASSES];
+    unsigned count[CACHE_CLASSES];
+    bool registered;
+};
+
+static __thread struct thread_cache cache;
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static inline size_t cache_class(size_t size) {
+    return size ? (size - 1) / CACHE_GRANULARITY : 0;
+}
+
+// Rend au tas les n premières zones de la classe c, le verrou étant déjà pris
+static void cache_release_locked(struct thread_cache *tc, size_t c, unsigned n) {
+    for (; n && tc->zones[c]; n--, tc->count[c]--) {
+        struct cached_zone *zone = tc->zones[c];
+        tc->zones[c] = zone->next;
+        mem_free(zone);
+    }
+}
+
+static void cache_flush_locked(struct thread_cache *tc) {
+    for (size_t c = 0; c < CACHE_CLASSES; c++) {
+        cache_release_locked(tc, c, tc->count[c]);
+    }
+}
+
+// Appelé à la fin de chaque thread qui a utilisé son cache
+static void cache_destroy(void *tc) {
+    lock();
+    cache_flush_locked(tc);
+    unlock();
+}
+
+static void cache_key_create() {
+    pthread_key_create(&cache_key, cache_destroy);
+}
+
+static void *cache_pop(size_t size) {
+    size_t c = cache_class(size);
+    struct cached_zone *zone = cache.zones[c];
+    if (zone) {
+        cache.zones[c] = zone->next;
+        cache.count[c]--;
+    }
+    return zone;
+}
+
+// La taille arrondie comme par do_malloc, qui est celle de la zone
+static inline size_t rounded_size(size_t s) {
+    return s <= CACHE_MAX_SIZE ? (cache_class(s) + 1) * CACHE_GRANULARITY : s;
+}
+
+static bool cache_push_sized(void *ptr, size_t size) {
+    // Une zone resservie depuis le cache échapperait au profileur, qui ne voit que mem_alloc et mem_free
+    if (profile_enabled) {
+        return false;
+    }
+    if (size < CACHE_GRANULARITY || size > CACHE_MAX_SIZE) {
+        return false;
+    }
+    if (!cache.registered) {
+        pthread_once(&cache_key_once, cache_key_create);
+        pthread_setspecific(cache_key, &cache);
+        cache.registered = true;
+    }
+
+    // Une zone n'est rangée que dans une classe dont elle peut servir toutes les tailles
+    size_t c = cache_class(size + 1) - 1;
+    struct cached_zone *zone = ptr;
+    zone->next = cache.zones[c];
+    cache.zones[c] = zone;
+    if (++cache.count[c] > CACHE_CLASS_MAX) {
+        lock();
+        cache_release_locked(&cache, c, CACHE_CLASS_MAX / 2);
+        unlock();
+    }
+    return true;
+}
+
+static bool cache_push(void *ptr) {
+    return cache_push_sized(ptr, mem_get_size_unchecked(ptr));
+}
+
+/* Traces binaires
+ *
+ * Si la variable d'environnement MEM_TRACE donne un nom de fichier, chaque opération y est enregistrée au format de
+ * trace.h, pour être décodée par bench/trace_decode puis rejouée par bench/bench. Avec MEM_TRACE_CALLSITE=1, chaque
+ * enregistrement porte aussi un hachage de l'adresse de l'appelant.
+ *
+ * Chaque thread remplit son propre tampon, sans allocation ; le tampon est écrit d'un seul write quand il est plein, à
+ * la fin du thread et à la fin du programme. Son verrou n'est disputé qu'à la fin du programme, quand trace_fini écrit
+ * les tampons des threads encore vivants. Les tampons sont projetés avec mmap et réutilisés par les threads suivants. Un
+ * processus fils n'enregistre rien.
+ *
+ * Une opération qui libère une zone (free, realloc) est datée avant l'appel à l'allocateur, une allocation après : une
+ * adresse n'est jamais vue réallouée par un autre thread avant d'avoir été libérée.
+ */
+#define TRACE_BUFFER_RECORDS 4096
+
+struct trace_buffer {
+    struct trace_record records[TRACE_BUFFER_RECORDS];
+    pthread_mutex_t lock;       // protège records et count
+    unsigned count;
+    uint16_t thread;
+    bool active;                // utilisé par un thread vivant
+    struct trace_buffer *next;  // liste de tous les tampons
+};
+
+static int trace_fd = -1;
+static bool trace_callsites;
+static struct trace_buffer *trace_buffers;
+static uint16_t trace_threads;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_key;
+static __thread struct trace_buffer *trace_buffer;
+
+static void trace_flush(struct trace_buffer *b) {
+    const char *data = (const char *) b->records;
+    size_t len = b->count * sizeof(struct trace_record);
+    while (len) {
+        ssize_t n = write(trace_fd, data, len);
+        if (n <= 0)
+            break;
+        data += n;
+        len -= n;
+    }
+    b->count = 0;
+}
+
+// Appelé à la fin de chaque thread qui a enregistré quelque chose
+static void trace_thread_exit(void *p) {
+    struct trace_buffer *b = p;
+    pthread_mutex_lock(&b->lock);
+    trace_flush(b);
+    pthread_mutex_unlock(&b->lock);
+    pthread_mutex_lock(&trace_lock);
+    b->active = false;
+    pthread_mutex_unlock(&trace_lock);
+    trace_buffer = NULL;
+}
+
+static struct trace_buffer *trace_acquire() {
+    pthread_mutex_lock(&trace_lock);
+    struct trace_buffer *b = trace_buffers;
+    while (b && b->active)
+        b = b->next;
+    if (!b) {
+        b = mmap(NULL, sizeof(struct trace_buffer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (b == MAP_FAILED) {
+            pthread_mutex_unlock(&trace_lock);
+            return NULL;
+        }
+        pthread_mutex_init(&b->lock, NULL);
+        b->next = trace_buffers;
+        trace_buffers = b;
+    }
+    b->active = true;
+    b->count = 0;
+    b->thread = trace_threads++;
+    pthread_mutex_unlock(&trace_lock);
+    pthread_setspecific(trace_key, b);
+    return b;
+}
+
+static uint64_t trace_now() {
+    if (trace_fd < 0)
+        return 0;
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000u + (uint64_t) t.tv_nsec;
+}
+
+// Enregistre une opération datée de time, pris par trace_now avant ou après l'appel à l'allocateur
+static void trace_at(uint64_t time, enum trace_op op, void *ptr, void *old, size_t size, void *caller) {
+    if (trace_fd < 0)
+        return;
+    struct trace_buffer *b = trace_buffer;
+    if (!b && !(b = trace_buffer = trace_acquire()))
+        return;
+
+    pthread_mutex_lock(&b->lock);
+    struct trace_record *r = &b->records[b->count];
+    r->time = time;
+    r->ptr = (uintptr_t) ptr;
+    r->old = (uintptr_t) old;
+    r->size = size;
+    r->callsite = trace_callsites ? (uint32_t) (((uint64_t) (uintptr_t) caller * 0x9E3779B97F4A7C15u) >> 32) : 0;
+    r->thread = b->thread;
+    r->op = op;
+    r->unused = 0;
+    if (++b->count == TRACE_BUFFER_RECORDS)
+        trace_flush(b);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void trace(enum trace_op op, void *ptr, void *old, size_t size, void *caller) {
+    trace_at(trace_now(), op, ptr, old, size, caller);
+}
+
+// Les tampons copiés par fork appartiennent au parent, qui les écrira lui-même
+static void trace_fork_child() {
+    trace_fd = -1;
+}
+
+__attribute__((constructor)) static void trace_init() {
+    const char *path = getenv("MEM_TRACE");
+    if (!path || !*path)
+        return;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+    struct trace_file_header header = {.version = TRACE_VERSION, .record_size = sizeof(struct trace_record)};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        close(fd);
+        return;
+    }
+    const char *callsites = getenv("MEM_TRACE_CALLSITE");
+    trace_callsites = callsites && *callsites && strcmp(callsites, "0");
+    pthread_key_create(&trace_key, trace_thread_exit);
+    pthread_atfork(NULL, NULL, trace_fork_child);
+    trace_fd = fd;
+}
+
+// Les threads encore vivants à la fin du programme n'ont pas écrit leur tampon
+__attribute__((destructor)) static void trace_fini() {
+    if (trace_fd < 0)
+        return;
+    pthread_mutex_lock(&trace_lock);
+    for (struct trace_buffer *b = trace_buffers; b; b = b->next) {
+        if (b->active) {
+            pthread_mutex_lock(&b->lock);
+            trace_flush(b);
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* Profil du tas
+ *
+ * Si la variable d'environnement MEM_PROFILE donne une période d'échantillonnage en octets, le profileur de mem.c est
+ * démarré. Le profil des zones encore allouées est écrit dans le fichier MEM_PROFILE_OUT (mem.folded par défaut) à la
+ * réception de SIGUSR2 et à la fin du programme.
+ */
+static const char *profile_path;
+
+__attribute__((constructor)) static void profile_init() {
+    const char *period = getenv("MEM_PROFILE");
+    if (!period || !*period)
+        return;
+    profile_path = getenv("MEM_PROFILE_OUT");
+    if (!profile_path || !*profile_path)
+        profile_path = "mem.folded";
+    if (mem_profile_start(strtoul(period, NULL, 10)))
+        mem_profile_dump_on_signal(SIGUSR2, profile_path);
+}
+
+__attribute__((destructor)) static void profile_fini() {
+    if (!profile_path)
+        return;
+    int fd = open(profile_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        mem_profile_dump(fd);
+        close(fd);
+    }
+}
+
+// Allocation sous verrou ; en cas d'échec, on rend d'abord le cache du thread au tas avant de réessayer
+static void *alloc_locked(size_t s) {
+    void *result = mem_alloc(s);
+    if (!result) {
+        cache_flush_locked(&cache);
+        result = mem_alloc(s);
+    }
+    return result;
+}
+
+static void *do_malloc(size_t s) {
     void *result;
 
-    init();
     dprintf("Allocation de %lu octets...", (unsigned long) s);
-    result = mem_alloc(s);
-    if (!result)
+    if (s <= CACHE_MAX_SIZE && (result = cache_pop(s))) {
+        dprintf(" %lx (cache)\n", (unsigned long) result);
+        return result;
+    }
+    // Les petites tailles sont arrondies à leur classe, pour que la zone puisse être resservie depuis le cache
+    size_t rounded = rounded_size(s);
+    lock();
+    result = alloc_locked(rounded);
+    unlock();
+    if (!result) {
         dprintf(" Alloc FAILED !!");
-    else
+        errno = ENOMEM;
+    } else
 	dprintf(" %lx\n", (unsigned long) result);
     return result;
 }
 
+void* malloc_info3 = &malloc;
+void *malloc(size_t s) {
+    void *result = do_malloc(s);
+    trace(TRACE_MALLOC, result, NULL, s, __builtin_return_address(0));
+    return result;
+}
+
 void *calloc(size_t count, size_t size) {
-    int i;
-    char *p;
-    size_t s = count*size;
+    void *p;
+    size_t s;
 
-    init();
+    if (__builtin_mul_overflow(count, size, &s)) {
+        errno = ENOMEM;
+        return NULL;
+    }
     dprintf("Allocation de %zu octets\n", s);
-    p = mem_alloc(s);
-    if (!p)
+    if (s <= CACHE_MAX_SIZE) {
+        // Une petite zone peut venir du cache : on l'efface entièrement
+        p = do_malloc(s);
+        if (p)
+            memset(p, 0, s);
+    } else {
+        // Le tas n'efface que ce qui a déjà servi
+        lock();
+        p = mem_calloc(count, size);
+        if (!p) {
+            cache_flush_locked(&cache);
+            p = mem_calloc(count, size);
+        }
+        unlock();
+    }
+    trace(TRACE_CALLOC, p, NULL, s, __builtin_return_address(0));
+    if (!p) {
         dprintf(" Alloc FAILED !!");
-    if (p)
-        for (i=0; i<s; i++)
-            p[i] = 0;
+        errno = ENOMEM;
+    }
     return p;
 }
 
-void *realloc(void *ptr, size_t size) {
-    size_t s;
+static void *do_realloc(void *ptr, size_t size) {
     char *result;
 
-    init();
     dprintf("Reallocation de la zone en %lx\n", (unsigned long) ptr);
     if (!ptr) {
         dprintf(" Realloc of NULL pointer\n");
-        return mem_alloc(size);
+        return do_malloc(size);
     }
-    if (mem_get_size(ptr) >= size) {
-        dprintf(" Useless realloc\n");
-        return ptr;
+    // Agrandissement ou rétrécissement sur place si possible, sinon allocation et memcpy
+    lock();
+    result = mem_realloc(ptr, size);
+    if (!result) {
+        cache_flush_locked(&cache);
+        result = mem_realloc(ptr, size);
     }
-    result = mem_alloc(size);
+    unlock();
     if (!result) {
         dprintf(" Realloc FAILED\n");
+        errno = ENOMEM;
         return NULL;
     }
-    for (s = 0; s<mem_get_size(ptr); s++)
-        result[s] = ((char *) ptr)[s];
-    mem_free(ptr);
     dprintf(" Realloc ok\n");
     return result;
 }
 
+void *realloc(void *ptr, size_t size) {
+    uint64_t start = trace_now();
+    void *result = do_realloc(ptr, size);
+    trace_at(start, TRACE_REALLOC, result, ptr, size, __builtin_return_address(0));
+    return result;
+}
+
+void *reallocarray(void *ptr, size_t count, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(count, size, &total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    uint64_t start = trace_now();
+    void *result = do_realloc(ptr, total);
+    trace_at(start, TRACE_REALLOC, result, ptr, total, __builtin_return_address(0));
+    return result;
+}
+
+/* Allocations alignées
+ *
+ * Jusqu'à 16 octets, malloc suffit. Au-delà, la zone est découpée à l'endroit aligné d'une zone libre du tas. Dans la
+ * trace, ces allocations apparaissent comme des malloc.
+ */
+static void *do_memalign(size_t alignment, size_t s) {
+    void *result;
+
+    dprintf("Allocation alignée sur %zu de %zu octets...", alignment, s);
+    if (alignment <= CACHE_GRANULARITY)
+        return do_malloc(s);
+    lock();
+    result = mem_alloc_aligned(s, alignment);
+    if (!result) {
+        cache_flush_locked(&cache);
+        result = mem_alloc_aligned(s, alignment);
+    }
+    unlock();
+    if (!result) {
+        dprintf(" Alloc FAILED !!");
+        errno = ENOMEM;
+    } else
+        dprintf(" %lx\n", (unsigned long) result);
+    return result;
+}
+
+static bool is_power_of_two(size_t n) {
+    return n && !(n & (n - 1));
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (!is_power_of_two(alignment) || alignment % sizeof(void *))
+        return EINVAL;
+    int saved_errno = errno; // posix_memalign renvoie l'erreur sans toucher à errno
+    void *result = do_memalign(alignment, size);
+    trace(TRACE_MALLOC, result, NULL, size, __builtin_return_address(0));
+    errno = saved_errno;
+    if (!result)
+        return ENOMEM;
+    *memptr = result;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    if (!is_power_of_two(alignment)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    void *result = do_memalign(alignment, size);
+    trace(TRACE_MALLOC, result, NULL, size, __builtin_return_address(0));
+    return result;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    if (!is_power_of_two(alignment)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    void *result = do_memalign(alignment, size);
+    trace(TRACE_MALLOC, result, NULL, size, __builtin_return_address(0));
+    return result;
+}
+
+void *valloc(size_t size) {
+    void *result = do_memalign(sysconf(_SC_PAGESIZE), size);
+    trace(TRACE_MALLOC, result, NULL, size, __builtin_return_address(0));
+    return result;
+}
+
+// Comme valloc, avec une taille arrondie au multiple de la taille de page
+void *pvalloc(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size = (size + page - 1) & ~(page - 1);
+    void *result = do_memalign(page, size);
+    trace(TRACE_MALLOC, result, NULL, size, __builtin_return_address(0));
+    return result;
+}
+
 void free(void *ptr) {
-    init();
     if (ptr) {
         dprintf("Liberation de la zone en %lx\n", (unsigned long) ptr);
-        mem_free(ptr);
+        trace(TRACE_FREE, ptr, NULL, 0, __builtin_return_address(0));
+        if (!cache_push(ptr)) {
+            lock();
+            mem_free(ptr);
+            unlock();
+        }
     } else {
         dprintf("Liberation de la zone NULL\n");
     }
 }
+
+/* Libérations avec taille (C23)
+ *
+ * La taille est celle demandée à malloc, calloc ou realloc (aligned_alloc pour free_aligned_sized). Elle évite de lire
+ * le tag de la zone pour la ranger dans le cache, et de chercher la zone parmi les slabs ou les grandes allocations.
+ */
+static void do_free_sized(void *ptr, size_t size) {
+    if (!cache_push_sized(ptr, size)) {
+        lock();
+        mem_free_sized(ptr, size);
+        unlock();
+    }
+}
+
+void free_sized(void *ptr, size_t size) {
+    if (ptr) {
+        trace(TRACE_FREE, ptr, NULL, 0, __builtin_return_address(0));
+        do_free_sized(ptr, rounded_size(size));
+    }
+}
+
+// Comme dans do_memalign, seul un petit alignement passe par do_malloc et arrondit la taille à sa classe ; sinon, la
+// zone n'est arrondie qu'au multiple de 16 octets
+void free_aligned_sized(void *ptr, size_t alignment, size_t size) {
+    if (ptr) {
+        trace(TRACE_FREE, ptr, NULL, 0, __builtin_return_address(0));
+        size_t aligned = (size + CACHE_GRANULARITY - 1) & ~(CACHE_GRANULARITY - 1);
+        do_free_sized(ptr, alignment <= CACHE_GRANULARITY ? rounded_size(size) : aligned);
+    }
+}
+
+/* Compléments de la glibc */
+
+// La taille allouée, qui peut dépasser la taille demandée (arrondi à la classe du cache, ou à l'alignement)
+size_t malloc_usable_size(void *ptr) {
+    return ptr ? mem_get_size_unchecked(ptr) : 0;
+}
+
+// Rend au système les pages libres du tas ; pad est ignoré
+int malloc_trim(size_t pad) {
+    (void) pad;
+    lock();
+    cache_flush_locked(&cache);
+    size_t released = mem_trim();
+    unlock();
+    return released > 0;
+}
+
+// Les grandes allocations ne sont pas comptées à part : hblks et hblkhd restent nuls
+struct mallinfo2 mallinfo2(void) {
+    struct mem_stats stats;
+    lock();
+    mem_stats(&stats);
+    unlock();
+    return (struct mallinfo2) {
+        .arena = stats.heap_size,
+        .ordblks = stats.free_zones,
+        .uordblks = stats.in_use,
+        .fordblks = stats.free,
+        .keepcost = stats.largest_free,
+    };
+}
+
+struct mallinfo mallinfo(void) {
+    struct mallinfo2 info = mallinfo2();
+    return (struct mallinfo) {
+        .arena = (int) info.arena,
+        .ordblks = (int) info.ordblks,
+        .uordblks = (int) info.uordblks,
+        .fordblks = (int) info.fordblks,
+        .keepcost = (int) info.keepcost,
+    };
+}
+
+/* fork
+ *
+ * Un autre thread peut tenir un verrou de l'allocateur au moment du fork : le fils, qui n'a plus que le thread
+ * appelant, ne pourrait jamais le reprendre. On prend donc tous les verrous avant le fork, dans l'ordre où
+ * l'allocateur les imbrique (le tas, puis le profileur qu'il appelle), et on les rend dans les deux processus. Les
+ * zones gardées dans les caches des autres threads sont perdues pour le fils.
+ */
+static void fork_prepare() {
+    pthread_mutex_lock(&heap_lock);
+    profile_fork_prepare();
+    pthread_mutex_lock(&trace_lock);
+}
+
+static void fork_parent() {
+    pthread_mutex_unlock(&trace_lock);
+    profile_fork_parent();
+    pthread_mutex_unlock(&heap_lock);
+}
+
+static void fork_child() {
+    pthread_mutex_init(&trace_lock, NULL);
+    profile_fork_child();
+    pthread_mutex_init(&heap_lock, NULL);
+}
+
+__attribute__((constructor)) static void fork_init() {
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
@@ -1,12 +1,19 @@
 /* On inclut l'interface publique */
 #include "mem.h"
 #include "common.h"
+#include "mem_profile.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <valgrind/valgrind.h>
 
 /* Définition de l'alignement recherché
@@ -39,251 +46,2437 @@ typedef uint32_t guard;
 #define GUARD_VALUE ((guard) 0xe91f8f05)
 #endif
 
+// Classes de taille de l'index ségrégué (voir mem_fit_segregated)
+// Les petites tailles (< 2^CLASS_FIRST_LOG) ont une classe par multiple de ALIGNMENT, les autres sont réparties en
+// SUB_CLASSES sous-classes par puissance de deux, comme dans TLSF.
+#define CLASS_FIRST_LOG 8
+#define LINEAR_CLASSES ((1 << CLASS_FIRST_LOG) / ALIGNMENT)
+#define SUB_CLASSES_LOG 2
+#define SUB_CLASSES (1 << SUB_CLASSES_LOG)
+#define SIZE_BITS (sizeof(size_t) * 8)
+#define NB_CLASSES (LINEAR_CLASSES + (SIZE_BITS - CLASS_FIRST_LOG) * SUB_CLASSES)
+#define CLASS_MAP_WORDS ((NB_CLASSES + 63) / 64)
+
+// Espace d'adressage réservé par défaut pour un tas extensible (voir mem_heap_create_mmap)
+// Seule la partie effectivement utilisée est accessible, la réservation elle-même ne coûte rien
+#define MMAP_DEFAULT_RESERVE (sizeof(void *) == 8 ? (size_t) 64 << 30 : (size_t) 256 << 20)
+#define MMAP_INITIAL_SIZE ((size_t) 64 << 10)
+// Par défaut, un tas extensible rend au système les pages des zones libres d'au moins cette taille (voir trim_free)
+#define MMAP_TRIM_THRESHOLD ((size_t) 128 << 10)
+// Par défaut, un tas extensible sert les allocations d'au moins cette taille par une projection dédiée
+#define MMAP_LARGE_THRESHOLD ((size_t) 256 << 10)
+
+// Taille maximale d'une zone, comme dans la glibc : au-delà, l'alignement et l'ajout des métadonnées déborderaient
+#define MAX_REQUEST_SIZE ((size_t) PTRDIFF_MAX)
+
+// Slabs des petits objets (voir slab_alloc)
+#define SLAB_SIZE ((size_t) 4096)
+#define SLAB_MAX_SIZE ((size_t) 64)
+#define SLAB_CLASSES (SLAB_MAX_SIZE / ALIGNMENT)
+#define SLAB_MAGIC 0x51ab51ab51ab51abull
+#define SLAB_MAP_WORDS ((SLAB_SIZE / ALIGNMENT + 63) / 64)
+
+// Libérations différées (voir mem_heap_defer_frees)
+#define DEFER_MAX_SIZE ((size_t) 512)
+#define DEFER_CLASSES (DEFER_MAX_SIZE / ALIGNMENT)
+
 enum error_code LAST_ERROR;
 
 static inline void set_error_code(enum error_code x) {
     LAST_ERROR = x;
 }
 
-/* structure placée au début de la zone de l'allocateur
+/* Lien entre deux emplacements du tas
+ *
+ * Tous les pointeurs rangés dans le tas (chaîne des fb, index, tags, slabs, en-tête) sont la distance entre le champ et
+ * sa cible, 0 désignant NULL : ils restent valables quelle que soit l'adresse où le tas est projeté, ce qui permet à
+ * des processus de partager un tas projeté à des adresses différentes (voir mem_heap_attach). Ils se lisent avec
+ * rel_get et s'écrivent avec rel_set, jamais par copie : la valeur n'a de sens qu'à l'emplacement du champ.
+ */
+typedef ptrdiff_t rel_ptr;
+
+static inline void *rel_get(const rel_ptr *field) {
+    return *field ? (void *) field + *field : NULL;
+}
+
+static inline void rel_set(rel_ptr *field, const void *target) {
+    *field = target ? target - (const void *) field : 0;
+}
+
+// Index maintenu en parallèle de la chaîne des fb, selon la stratégie choisie
+enum fb_index {
+    INDEX_NONE,
+    INDEX_SEGREGATED,
+    INDEX_TREE,
+};
+
+/* Compteurs de mem_heap_stats, tenus à jour au fil des opérations plutôt que calculés en parcourant la chaîne
+ *
+ * Les zones libres sont comptées à leur entrée et à leur sortie de l'index (index_insert et index_remove encadrent
+ * chaque changement de taille d'un fb), qu'un index soit construit ou non. Seule la plus grande zone libre est connue
+ * paresseusement : quand elle disparaît, elle n'est recherchée qu'au prochain appel à mem_heap_stats.
+ */
+struct heap_counters {
+    size_t in_use;          // octets alloués (tailles alignées), grandes allocations comprises
+    size_t free;            // somme des fb_free_space des zones libres
+    size_t free_zones;
+    size_t largest_free;    // valable seulement si largest_known
+    bool largest_known;
+    size_t allocs;
+    size_t frees;
+    size_t failed;
+    size_t searches;        // appels à la fonction de fit
+    size_t search_steps;    // zones (ou classes, ou nœuds) examinées par les stratégies fournies
+    size_t splits;          // zones libres découpées par une allocation
+    size_t merges;          // zones libérées fusionnées avec la zone libre qui les suit
+};
+
+/* structure placée au début de la zone de l'allocateur
+
+   Elle contient toutes les variables globales nécessaires au
+   fonctionnement de l'allocateur
+
+   Elle peut bien évidemment être complétée
+*/
+struct allocator_header {
+    size_t memory_size;
+    size_t reserved_size; // non nul pour un tas extensible : taille de la réservation dont memory_size est utilisé
+    // Politique de restitution de la mémoire au système (voir mem_heap_trim_policy)
+    size_t trim_threshold;
+    size_t trim_high_water;
+    size_t freed_since_trim;
+    // Grandes allocations, hors du tas (voir large_alloc) : adresses absolues, propres au processus
+    size_t large_threshold;
+    struct large_block *large;
+    // La mémoire du tas à partir de cette adresse n'a jamais été écrite : elle est nulle si elle vient de mmap
+    // (voir mem_heap_calloc)
+    rel_ptr fresh;
+    mem_fit_function_t *fit;
+    // Point de reprise de mem_fit_next : la zone libre qui suit la dernière zone découpée (NULL pour le début)
+    rel_ptr rover;
+    bool guards_enabled;
+    bool tags_enabled;
+    bool slabs_enabled;
+    bool size_checks_enabled;
+    enum fb_index index;
+    // Index ségrégué : une liste de zones libres par classe de taille, et un bit par classe non vide
+    uint64_t class_map[CLASS_MAP_WORDS];
+    rel_ptr classes[NB_CLASSES];
+    // Arbre des zones libres par taille : racine et plus grande zone
+    rel_ptr tree_root;
+    rel_ptr tree_max;
+    struct heap_counters counters;
+    // Slabs des petits objets, par classe : ceux qui ont des objets libres (voir slab_alloc)
+    rel_ptr slabs[SLAB_CLASSES];
+    // Zones libérées en attente de fusion, par taille (voir mem_heap_defer_frees)
+    size_t defer_budget;
+    size_t deferred_bytes;
+    rel_ptr deferred[DEFER_CLASSES];
+    // Tas partagé entre processus (voir mem_heap_create_shared). La stratégie y est désignée par son rang dans
+    // shared_fits, fit n'étant valable que dans un processus. Un tas empoisonné refuse toute opération.
+    bool shared;
+    bool poisoned;
+    size_t fit_id;
+    pthread_mutex_t lock;
+} __attribute__ ((aligned (16))); // Essentiel au bon fonctionnement de l'allocateur
+
+
+/* La seule variable globale autorisée
+ * On trouve à cette adresse le début de la zone à gérer
+ * (et une structure 'struct allocator_header)
+ *
+ * C'est le tas par défaut, utilisé par les fonctions mem_* ; les fonctions mem_heap_* travaillent sur un tas quelconque,
+ * désigné par un struct mem_heap* qui n'est autre que l'adresse de son allocator_header.
+ */
+static void *memory_addr;
+
+static inline struct allocator_header *heap_header(struct mem_heap *heap) {
+    return (struct allocator_header *) heap;
+}
+
+struct mem_heap *mem_default_heap() {
+    return (struct mem_heap *) memory_addr;
+}
+
+static inline void *get_system_memory_addr() {
+    return memory_addr;
+}
+
+static inline struct allocator_header *get_header() {
+    struct allocator_header *h;
+    h = get_system_memory_addr();
+    return h;
+}
+
+static inline struct fb *fb_head(struct allocator_header *h) {
+    return (struct fb *) ((void *) h + sizeof(struct allocator_header));
+}
+
+static inline size_t get_system_memory_size() {
+    return get_header()->memory_size;
+}
+
+// Retrouve l'en-tête à partir de la tête de la liste passée aux fonctions de fit
+static inline struct allocator_header *header_of(struct fb *list) {
+    return (struct allocator_header *) ((void *) list - sizeof(struct allocator_header));
+}
+
+/* Verrou d'un tas partagé
+ *
+ * Les fonctions publiques qui touchent au tas commencent par HEAP_LOCKED_OR(h, val), qui prend le verrou d'un tas
+ * partagé et le rend à la sortie de la fonction. Le verrou est récursif, ces fonctions s'appelant entre elles. Les tas
+ * privés ne sont pas verrouillés : c'est à l'appelant de les protéger (voir malloc_stub.c).
+ *
+ * Si un processus meurt en tenant le verrou, le tas a pu rester à moitié modifié : le suivant à prendre le verrou
+ * empoisonne le tas, et toute opération échoue ensuite en renvoyant val (LAST_ERROR vaut HEAP_POISONED). Il ne reste
+ * qu'à détruire le tas.
+ */
+static inline struct allocator_header *heap_lock(struct allocator_header *h) {
+    if (h->shared && pthread_mutex_lock(&h->lock) == EOWNERDEAD) {
+        h->poisoned = true;
+        pthread_mutex_consistent(&h->lock);
+    }
+    return h;
+}
+
+static inline void heap_unlock(struct allocator_header **h) {
+    if ((*h)->shared) {
+        pthread_mutex_unlock(&(*h)->lock);
+    }
+}
+
+#define HEAP_LOCKED_OR(h, val) \
+    struct allocator_header *heap_locked __attribute__ ((cleanup (heap_unlock))) = heap_lock(h);\
+    if (heap_locked->poisoned) {\
+        set_error_code(HEAP_POISONED);\
+        return val;}
+
+// Stratégies utilisables par un tas partagé, qui n'enregistre que leur rang
+static mem_fit_function_t *const shared_fits[] = {
+    &mem_fit_first, &mem_fit_next, &mem_fit_best, &mem_fit_worst, &mem_fit_segregated, &mem_fit_best_tree,
+    &mem_fit_worst_tree,
+};
+#define NB_SHARED_FITS (sizeof(shared_fits) / sizeof(shared_fits[0]))
+
+static inline mem_fit_function_t *heap_fit(struct allocator_header *h) {
+    return h->shared ? shared_fits[h->fit_id] : h->fit;
+}
+
+static void index_rebuild(struct allocator_header *h, enum fb_index index);
+
+/* Choisit la stratégie d'allocation du tas
+ *
+ * Un tas partagé ne peut utiliser qu'une des stratégies fournies (une autre est ignorée) : l'adresse d'une fonction
+ * n'est pas la même dans tous les processus.
+ */
+void mem_heap_fit(struct mem_heap *heap, mem_fit_function_t *f) {
+    HEAP_LOCKED_OR(heap_header(heap), );
+    struct allocator_header *h = heap_header(heap);
+    if (h->shared) {
+        size_t id = 0;
+        while (id < NB_SHARED_FITS && shared_fits[id] != f) {
+            id++;
+        }
+        if (id == NB_SHARED_FITS) {
+            return;
+        }
+        h->fit_id = id;
+    }
+    h->fit = f;
+    if (f == &mem_fit_segregated) {
+        index_rebuild(h, INDEX_SEGREGATED);
+    } else if (f == &mem_fit_best_tree || f == &mem_fit_worst_tree) {
+        index_rebuild(h, INDEX_TREE);
+    } else {
+        index_rebuild(h, INDEX_NONE);
+    }
+}
+
+void mem_fit(mem_fit_function_t *f) {
+    mem_heap_fit(mem_default_heap(), f);
+}
+
+void mem_size(size_t size) {
+    get_header()->memory_size = size;
+}
+
+// Voir nos schémas pour comprendre notre utilisation de fb
+struct fb {
+    size_t size;
+    rel_ptr next;
+};
+
+static inline struct fb *fb_next(struct fb *fb) {
+    return rel_get(&fb->next);
+}
+
+static inline void fb_set_next(struct fb *fb, struct fb *next) {
+    rel_set(&fb->next, next);
+}
+
+/* Chaînage d'une zone libre dans l'index ségrégué
+ *
+ * Il est stocké juste après le fb, dans l'espace libre lui-même : seules les zones dont la taille est d'au moins
+ * 2*sizeof(struct fb) sont indexées, mais ce sont aussi les seules qui peuvent satisfaire une allocation.
+ */
+struct fb_links {
+    rel_ptr prev;
+    rel_ptr next;
+};
+
+/* Nœud d'une zone libre dans l'arbre des tailles, au même emplacement que fb_links
+ *
+ * C'est un treap : un arbre binaire de recherche sur la clé (espace libre, adresse), qui est aussi un tas sur une
+ * priorité pseudo-aléatoire. Celle-ci étant un hachage de l'adresse, elle n'a pas besoin d'être stockée et deux
+ * pointeurs suffisent, pour une profondeur logarithmique en moyenne.
+ */
+struct fb_node {
+    rel_ptr left;
+    rel_ptr right;
+};
+
+/* En-tête placé au début de chaque zone allouée lorsque les boundary tags sont activés
+ *
+ * Il désigne le fb qui précède la zone (celui tel que fb + fb->size == zone), ce qui permet de retrouver la zone en temps
+ * constant au lieu de parcourir la chaîne. La taille utile est stockée avec un bit d'occupation, les tailles étant
+ * alignées. Pas besoin de pied de bloc : la fusion avec les deux voisins se fait déjà via le fb précédent et son next.
+ */
+struct tag {
+    rel_ptr fb;
+    size_t size;
+} __attribute__ ((aligned (ALIGNMENT)));
+
+#define TAG_IN_USE ((size_t) 1)
+
+static inline struct fb_links *fb_links(struct fb *fb) {
+    return (struct fb_links *) (fb + 1);
+}
+
+static inline struct fb_node *fb_node(struct fb *fb) {
+    return (struct fb_node *) (fb + 1);
+}
+
+// Ce qu'on ne doit pas écraser au début d'une zone libre : le fb et son éventuel chaînage dans l'index
+#define FB_METADATA_SIZE (sizeof(struct fb) + sizeof(struct fb_links))
+
+static inline bool fb_indexable(struct fb *fb) {
+    return fb->size >= 2 * sizeof(struct fb);
+}
+
+// Espace réellement allouable dans une zone libre (même calcul que dans les fonctions de fit)
+static inline size_t fb_free_space(struct fb *fb) {
+    return fb->size - 2 * sizeof(struct fb);
+}
+
+static inline size_t size_class(size_t size) {
+    if (size < ((size_t) 1 << CLASS_FIRST_LOG)) {
+        return size / ALIGNMENT;
+    }
+    size_t log = sizeof(unsigned long) * 8 - 1 - __builtin_clzl((unsigned long) size);
+    size_t sub = (size >> (log - SUB_CLASSES_LOG)) & (SUB_CLASSES - 1);
+    return LINEAR_CLASSES + (log - CLASS_FIRST_LOG) * SUB_CLASSES + sub;
+}
+
+// Plus petite taille rangée dans la classe c
+static inline size_t class_min_size(size_t c) {
+    if (c < LINEAR_CLASSES) {
+        return c * ALIGNMENT;
+    }
+    size_t log = CLASS_FIRST_LOG + (c - LINEAR_CLASSES) / SUB_CLASSES;
+    size_t sub = (c - LINEAR_CLASSES) % SUB_CLASSES;
+    return ((size_t) 1 << log) + (sub << (log - SUB_CLASSES_LOG));
+}
+
+// Première classe non vide à partir de c, ou NB_CLASSES s'il n'y en a pas
+static size_t class_map_find(struct allocator_header *h, size_t c) {
+    for (size_t word = c / 64; word < CLASS_MAP_WORDS && c < NB_CLASSES; word++, c = word * 64) {
+        uint64_t bits = h->class_map[word] & (~(uint64_t) 0 << (c % 64));
+        if (bits) {
+            return word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return NB_CLASSES;
+}
+
+static void seg_insert(struct allocator_header *h, struct fb *fb) {
+    size_t c = size_class(fb_free_space(fb));
+    struct fb_links *links = fb_links(fb);
+    struct fb *next = rel_get(&h->classes[c]);
+    rel_set(&links->prev, NULL);
+    rel_set(&links->next, next);
+    if (next) {
+        rel_set(&fb_links(next)->prev, fb);
+    }
+    rel_set(&h->classes[c], fb);
+    h->class_map[c / 64] |= (uint64_t) 1 << (c % 64);
+}
+
+static void seg_remove(struct allocator_header *h, struct fb *fb) {
+    size_t c = size_class(fb_free_space(fb));
+    struct fb_links *links = fb_links(fb);
+    struct fb *prev = rel_get(&links->prev);
+    struct fb *next = rel_get(&links->next);
+    if (prev) {
+        rel_set(&fb_links(prev)->next, next);
+    } else {
+        rel_set(&h->classes[c], next);
+        if (!next) {
+            h->class_map[c / 64] &= ~((uint64_t) 1 << (c % 64));
+        }
+    }
+    if (next) {
+        rel_set(&fb_links(next)->prev, prev);
+    }
+}
+
+// Ordre de l'arbre : espace libre croissant, puis adresse croissante (comme le parcours de mem_fit_best)
+static inline bool tree_less(struct fb *a, struct fb *b) {
+    size_t size_a = fb_free_space(a), size_b = fb_free_space(b);
+    return size_a < size_b || (size_a == size_b && a < b);
+}
+
+// Hachage de la position dans le tas, pour que tous les processus qui partagent le tas voient les mêmes priorités
+static inline uint64_t tree_priority(struct allocator_header *h, struct fb *fb) {
+    return (uint64_t) ((void *) fb - (void *) h) * 0x9e3779b97f4a7c15;
+}
+
+static inline struct fb *tree_left(struct fb *fb) {
+    return rel_get(&fb_node(fb)->left);
+}
+
+static inline struct fb *tree_right(struct fb *fb) {
+    return rel_get(&fb_node(fb)->right);
+}
+
+static struct fb *tree_insert(struct allocator_header *h, struct fb *root, struct fb *fb) {
+    if (!root) {
+        rel_set(&fb_node(fb)->left, NULL);
+        rel_set(&fb_node(fb)->right, NULL);
+        return fb;
+    }
+    struct fb_node *node = fb_node(root);
+    if (tree_less(fb, root)) {
+        struct fb *left = tree_insert(h, tree_left(root), fb);
+        if (tree_priority(h, left) > tree_priority(h, root)) {
+            rel_set(&node->left, tree_right(left));
+            rel_set(&fb_node(left)->right, root);
+            return left;
+        }
+        rel_set(&node->left, left);
+    } else {
+        struct fb *right = tree_insert(h, tree_right(root), fb);
+        if (tree_priority(h, right) > tree_priority(h, root)) {
+            rel_set(&node->right, tree_left(right));
+            rel_set(&fb_node(right)->left, root);
+            return right;
+        }
+        rel_set(&node->right, right);
+    }
+    return root;
+}
+
+// Fusionne deux arbres dont toutes les clés de a sont inférieures à celles de b
+static struct fb *tree_join(struct allocator_header *h, struct fb *a, struct fb *b) {
+    if (!a || !b) {
+        return a ? a : b;
+    }
+    if (tree_priority(h, a) > tree_priority(h, b)) {
+        rel_set(&fb_node(a)->right, tree_join(h, tree_right(a), b));
+        return a;
+    }
+    rel_set(&fb_node(b)->left, tree_join(h, a, tree_left(b)));
+    return b;
+}
+
+static struct fb *tree_remove(struct allocator_header *h, struct fb *root, struct fb *fb) {
+    if (!root) {
+        return NULL;
+    }
+    if (root == fb) {
+        return tree_join(h, tree_left(fb), tree_right(fb));
+    }
+    if (tree_less(fb, root)) {
+        rel_set(&fb_node(root)->left, tree_remove(h, tree_left(root), fb));
+    } else {
+        rel_set(&fb_node(root)->right, tree_remove(h, tree_right(root), fb));
+    }
+    return root;
+}
+
+// Seules les zones qui peuvent accueillir au moins un octet sont comptées comme libres
+static inline bool fb_counted(struct fb *fb) {
+    return fb->size > 2 * sizeof(struct fb);
+}
+
+static void index_insert(struct allocator_header *h, struct fb *fb) {
+    // Toute écriture de l'allocateur ou de l'utilisateur a lieu avant un fb qui passe par ici
+    if ((void *) fb + FB_METADATA_SIZE > rel_get(&h->fresh)) {
+        rel_set(&h->fresh, (void *) fb + FB_METADATA_SIZE);
+    }
+    if (fb_counted(fb)) {
+        h->counters.free += fb_free_space(fb);
+        h->counters.free_zones++;
+        if (h->counters.largest_known && fb_free_space(fb) > h->counters.largest_free) {
+            h->counters.largest_free = fb_free_space(fb);
+        }
+    }
+    if (h->index == INDEX_NONE || !fb_indexable(fb)) {
+        return;
+    }
+    if (h->index == INDEX_SEGREGATED) {
+        seg_insert(h, fb);
+    } else {
+        rel_set(&h->tree_root, tree_insert(h, rel_get(&h->tree_root), fb));
+        struct fb *max = rel_get(&h->tree_max);
+        if (!max || tree_less(max, fb)) {
+            rel_set(&h->tree_max, fb);
+        }
+    }
+}
+
+// À appeler AVANT de modifier la taille de la zone, sans quoi on ne retrouverait pas sa place dans l'index
+static void index_remove(struct allocator_header *h, struct fb *fb) {
+    if (fb_counted(fb)) {
+        h->counters.free -= fb_free_space(fb);
+        h->counters.free_zones--;
+        if (fb_free_space(fb) == h->counters.largest_free) {
+            h->counters.largest_known = false;
+        }
+    }
+    if (h->index == INDEX_NONE || !fb_indexable(fb)) {
+        return;
+    }
+    if (h->index == INDEX_SEGREGATED) {
+        seg_remove(h, fb);
+    } else {
+        struct fb *max = tree_remove(h, rel_get(&h->tree_root), fb);
+        rel_set(&h->tree_root, max);
+        if (rel_get(&h->tree_max) == fb) {
+            while (max && tree_right(max)) {
+                max = tree_right(max);
+            }
+            rel_set(&h->tree_max, max);
+        }
+    }
+}
+
+bool is_fb_link_valid(struct fb *x) {
+    if (fb_next(x) == NULL) {
+        return true;
+    } else {
+        struct fb *y = fb_next(x);
+        // La zone allouée entre les deux peut être vide (mem_alloc(0))
+        size_t dif = (size_t) ((void *) y - (void *) x);
+        return x->size <= dif;
+    }
+}
+
+// Le bloc alloué qui suit la zone libre fb (s'il existe) doit désigner fb comme précédent
+static inline void tag_adopt(struct allocator_header *h, struct fb *fb) {
+    if (h->tags_enabled && fb_next(fb)) {
+        rel_set(&((struct tag *) ((void *) fb + fb->size))->fb, fb);
+    }
+}
+
+// Le fb absorbed vient d'être fusionné dans into : le point de reprise de mem_fit_next ne doit pas rester dessus
+static inline void fb_absorbed(struct allocator_header *h, struct fb *absorbed, struct fb *into) {
+    if (rel_get(&h->rover) == absorbed) {
+        rel_set(&h->rover, into);
+    }
+}
+
+// Nombre d'octets entre le début d'une zone allouée et le pointeur donné à l'utilisateur
+static inline size_t block_prefix(struct allocator_header *h) {
+    return (h->tags_enabled ? sizeof(struct tag) : 0) + (h->guards_enabled ? sizeof(guard) : 0);
+}
+
+// Reconstruit l'index à partir de la chaîne, lors d'un changement de stratégie, ainsi que les compteurs des zones libres
+static void index_rebuild(struct allocator_header *h, enum fb_index index) {
+    h->index = index;
+    h->counters.free = 0;
+    h->counters.free_zones = 0;
+    h->counters.largest_free = 0;
+    h->counters.largest_known = true;
+    memset(h->class_map, 0, sizeof(h->class_map));
+    memset(h->classes, 0, sizeof(h->classes));
+    h->tree_root = 0;
+    h->tree_max = 0;
+    for (struct fb *cell = fb_head(h); cell; cell = fb_next(cell)) {
+        index_insert(h, cell);
+    }
+}
+
+
+static inline size_t page_size() {
+    return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+static inline size_t align_to_page(size_t size) {
+    size_t page = page_size();
+    return (size + page - 1) & ~(page - 1);
+}
+
+/* Rend au système les pages entièrement comprises dans [start, end[ et dans la partie libre de la zone fb
+ *
+ * Le contenu de ces pages est perdu (elles seront relues comme des zéros), ce qui ne pose pas de problème pour de la
+ * mémoire libre, tant qu'on ne touche pas aux métadonnées du début de la zone. Renvoie le nombre d'octets rendus.
+ * MADV_DONTNEED ne libérerait pas les pages d'une projection partagée, seulement leur copie dans ce processus : un tas
+ * partagé utilise MADV_REMOVE.
+ */
+static size_t release_pages(struct allocator_header *h, struct fb *fb, void *start, void *end) {
+    size_t page = page_size();
+    uintptr_t first = (uintptr_t) start, last = (uintptr_t) end;
+    if (first < (uintptr_t) fb + FB_METADATA_SIZE) {
+        first = (uintptr_t) fb + FB_METADATA_SIZE;
+    }
+    if (last > (uintptr_t) fb + fb->size) {
+        last = (uintptr_t) fb + fb->size;
+    }
+    first = (first + page - 1) & ~(page - 1);
+    last &= ~(page - 1);
+    if (last <= first || madvise((void *) first, last - first, h->shared ? MADV_REMOVE : MADV_DONTNEED)) {
+        return 0;
+    }
+    return last - first;
+}
+
+static size_t heap_trim(struct allocator_header *h) {
+    size_t released = 0;
+    for (struct fb *cell = fb_head(h); cell; cell = fb_next(cell)) {
+        FB_VALID_OR(cell, released);
+        released += release_pages(h, cell, cell, (void *) cell + cell->size);
+    }
+    h->freed_since_trim = 0;
+    return released;
+}
+
+/* Restitution au fil des libérations, appelée une fois la zone [start, end[ fusionnée dans fb
+ *
+ * Si la zone libre résultante est assez grande, on rend les pages de la partie qui vient d'être libérée. Les parties
+ * de fb qui l'entourent ont déjà été rendues si elles atteignaient le seuil ; plus petites, elles ne l'ont jamais été,
+ * et on les rend aussi. Le coût reste proportionnel à la taille libérée (plus deux fois le seuil au pire), et une petite
+ * libération ne fait jamais d'appel système. Au-delà de trim_high_water octets libérés, on repasse sur tout le tas.
+ */
+static void trim_free(struct allocator_header *h, struct fb *fb, void *start, void *end) {
+    if (h->trim_threshold && fb->size >= h->trim_threshold) {
+        void *fb_end = (void *) fb + fb->size;
+        release_pages(h, fb, (size_t) (start - (void *) fb) < h->trim_threshold ? (void *) fb : start,
+                      (size_t) (fb_end - end) < h->trim_threshold ? fb_end : end);
+    }
+    if (h->trim_high_water) {
+        h->freed_since_trim += end - start;
+        if (h->freed_since_trim >= h->trim_high_water) {
+            heap_trim(h);
+        }
+    }
+}
+
+size_t mem_heap_trim(struct mem_heap *heap) {
+    HEAP_LOCKED_OR(heap_header(heap), 0);
+    return heap_trim(heap_header(heap));
+}
+
+size_t mem_trim() {
+    return mem_heap_trim(mem_default_heap());
+}
+
+/* Règle la restitution automatique de la mémoire libre au système
+ *
+ * region_threshold : taille à partir de laquelle une zone libre obtenue par fusion voit ses pages rendues
+ * high_water : quantité de mémoire libérée au-delà de laquelle on rend toutes les zones libres du tas (mem_heap_trim)
+ * Une valeur nulle désactive le mécanisme correspondant.
+ */
+void mem_heap_trim_policy(struct mem_heap *heap, size_t region_threshold, size_t high_water) {
+    HEAP_LOCKED_OR(heap_header(heap), );
+    struct allocator_header *h = heap_header(heap);
+    h->trim_threshold = region_threshold;
+    h->trim_high_water = high_water;
+    h->freed_since_trim = 0;
+}
+
+/* Agrandit un tas extensible pour que sa dernière zone libre puisse accueillir size octets
+ *
+ * La mémoire rendue accessible prolonge le tas : il suffit d'agrandir la dernière zone libre, qui va toujours jusqu'à
+ * la fin du tas. La taille est au moins doublée à chaque fois, ce qui amortit le parcours de la chaîne.
+ */
+static bool heap_grow(struct allocator_header *h, size_t size) {
+    if (!h->reserved_size) {
+        return false;
+    }
+
+    struct fb *tail = fb_head(h);
+    while (fb_next(tail)) {
+        FB_VALID_OR(tail, false);
+        tail = fb_next(tail);
+    }
+
+    size_t needed = size + 2 * sizeof(struct fb);
+    size_t missing = tail->size < needed ? needed - tail->size : 0;
+    size_t new_size = align_to_page(h->memory_size + (missing > h->memory_size ? missing : h->memory_size));
+    if (new_size > h->reserved_size) {
+        new_size = h->reserved_size;
+    }
+    if (new_size - h->memory_size < missing) {
+        return false;
+    }
+    if (mprotect((void *) h + h->memory_size, new_size - h->memory_size, PROT_READ | PROT_WRITE)) {
+        return false;
+    }
+
+    index_remove(h, tail);
+    tail->size += new_size - h->memory_size;
+    index_insert(h, tail);
+    h->memory_size = new_size;
+    return true;
+}
+
+/* En-tête d'une grande allocation
+ *
+ * Une allocation d'au moins large_threshold octets ne passe pas par la chaîne des fb : elle a sa propre projection
+ * mmap, rendue par munmap à la libération et agrandie sans copie par mremap. Ces allocations étant peu nombreuses, on
+ * les garde dans une liste doublement chaînée depuis l'en-tête du tas, qui sert à valider les libérations.
+ */
+struct large_block {
+    struct large_block *prev;
+    struct large_block *next;
+    size_t mapped;
+    size_t size; // taille demandée, alignée (vérifiée par mem_heap_free_sized)
+} __attribute__ ((aligned (ALIGNMENT)));
+
+static inline struct large_block *large_of(void *ptr) {
+    return (struct large_block *) ptr - 1;
+}
+
+// Le pointeur est-il dans l'espace du tas ? Sinon, ce ne peut être qu'une grande allocation
+static inline bool heap_contains(struct allocator_header *h, void *ptr) {
+    return (uintptr_t) ptr - (uintptr_t) h < (h->reserved_size ? h->reserved_size : h->memory_size);
+}
+
+static struct large_block *large_find(struct allocator_header *h, void *ptr) {
+    for (struct large_block *large = h->large; large; large = large->next) {
+        if (large + 1 == ptr) {
+            return large;
+        }
+    }
+    set_error_code(NOT_ALLOCATED);
+    return NULL;
+}
+
+static inline void large_link(struct allocator_header *h, struct large_block *large) {
+    large->prev = NULL;
+    large->next = h->large;
+    if (large->next) {
+        large->next->prev = large;
+    }
+    h->large = large;
+}
+
+static inline void large_unlink(struct allocator_header *h, struct large_block *large) {
+    if (large->prev) {
+        large->prev->next = large->next;
+    } else {
+        h->large = large->next;
+    }
+    if (large->next) {
+        large->next->prev = large->prev;
+    }
+}
+
+static inline size_t large_size(struct large_block *large) {
+    return large->mapped - sizeof(struct large_block);
+}
+
+static void *large_alloc(struct allocator_header *h, size_t size) {
+    // L'arrondi à la page déborderait
+    if (size > SIZE_MAX - sizeof(struct large_block) - page_size()) {
+        return NULL;
+    }
+    size_t mapped = align_to_page(sizeof(struct large_block) + size);
+    struct large_block *large = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (large == MAP_FAILED) {
+        return NULL;
+    }
+    large->mapped = mapped;
+    large->size = size;
+    large_link(h, large);
+    h->counters.in_use += large_size(large);
+    VALGRIND_MEMPOOL_ALLOC(h, large + 1, size);
+    return large + 1;
+}
+
+static void large_free(struct allocator_header *h, struct large_block *large) {
+    large_unlink(h, large);
+    h->counters.in_use -= large_size(large);
+    VALGRIND_MEMPOOL_FREE(h, large + 1);
+    munmap(large, large->mapped);
+}
+
+// Agrandit ou rétrécit une grande allocation, en la déplaçant si besoin mais sans copie
+static void *large_realloc(struct allocator_header *h, struct large_block *large, size_t size) {
+    if (size > SIZE_MAX - sizeof(struct large_block) - page_size()) {
+        return NULL;
+    }
+    size = (size + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+    size_t mapped = align_to_page(sizeof(struct large_block) + size);
+    large_unlink(h, large);
+    struct large_block *moved = mremap(large, large->mapped, mapped, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED) {
+        large_link(h, large);
+        return NULL;
+    }
+    // L'ancien en-tête n'est plus lisible si la projection a été déplacée : on compte depuis le nouveau
+    h->counters.in_use -= moved->mapped;
+    h->counters.in_use += mapped;
+    moved->mapped = mapped;
+    moved->size = size;
+    large_link(h, moved);
+    VALGRIND_MEMPOOL_CHANGE(h, large + 1, moved + 1, size);
+    return moved + 1;
+}
+
+/* Règle la taille à partir de laquelle une allocation a sa propre projection mmap (0 pour désactiver)
+ *
+ * Par défaut, seuls les tas extensibles ont ce seuil (MMAP_LARGE_THRESHOLD).
+ */
+void mem_heap_large_threshold(struct mem_heap *heap, size_t threshold) {
+    // Les projections des grandes allocations sont privées : un tas partagé n'en a pas
+    if (!heap_header(heap)->shared) {
+        heap_header(heap)->large_threshold = threshold;
+    }
+}
+
+/* Crée un tas dans les taille octets de mem
+ *
+ * Renvoie NULL si mem n'est pas aligné sur ALIGNMENT, ou trop petit pour contenir l'en-tête et une première zone libre.
+ */
+struct mem_heap *mem_heap_create(void *mem, size_t taille, unsigned flags) {
+    // On s'assure que l'attribut ((aligned)) ci-dessus marche bien avec notre compilateur
+    // Un bon compilateur optimisera sans aucun doute la ligne ci-dessous en l'enlevant
+    assert(sizeof(struct allocator_header) % 16 == 0);
+
+    if (!mem || (uintptr_t) mem % ALIGNMENT || taille < sizeof(struct allocator_header) + FB_METADATA_SIZE) {
+        return NULL;
+    }
+
+    //On met en place allocator header
+    struct allocator_header *h = mem;
+    *h = (struct allocator_header) {
+        .memory_size = taille,
+        .guards_enabled = flags & MEM_GUARDS,
+        .tags_enabled = flags & MEM_BOUNDARY_TAGS,
+        // Les objets des slabs n'ont pas de gardes : on s'en passe pour déboguer
+        .slabs_enabled = (flags & MEM_SLABS) && !(flags & MEM_GUARDS),
+        .size_checks_enabled = flags & MEM_SIZE_CHECKS,
+    };
+    // On ne sait rien du contenu de la mémoire fournie
+    rel_set(&h->fresh, mem + taille);
+
+    VALGRIND_CREATE_MEMPOOL(mem, sizeof(struct fb), false);
+
+    // On met en place fb
+    struct fb *head = fb_head(h);
+    head->size = taille - sizeof(struct allocator_header);
+    fb_set_next(head, NULL);
+
+    struct mem_heap *heap = mem;
+    mem_heap_fit(heap, &mem_fit_first);
+    return heap;
+}
+
+
+/* Crée un tas extensible, qui n'a pas besoin d'une zone mémoire fournie à l'avance
+ *
+ * On réserve reserve octets d'espace d'adressage (MMAP_DEFAULT_RESERVE si nul, ou moins si le système refuse) sans les
+ * rendre accessibles, puis le tas grandit par mprotect dans cette réservation à chaque fois qu'une allocation échoue.
+ */
+struct mem_heap *mem_heap_create_mmap(size_t reserve, unsigned flags) {
+    size_t initial = align_to_page(sizeof(struct allocator_header) + MMAP_INITIAL_SIZE);
+    reserve = align_to_page(reserve ? reserve : MMAP_DEFAULT_RESERVE);
+
+    void *mem = MAP_FAILED;
+    for (; reserve >= initial; reserve = align_to_page(reserve / 2)) {
+        mem = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem != MAP_FAILED) {
+            break;
+        }
+    }
+    if (mem == MAP_FAILED || mprotect(mem, initial, PROT_READ | PROT_WRITE)) {
+        return NULL;
+    }
+
+    struct mem_heap *heap = mem_heap_create(mem, initial, flags);
+    heap_header(heap)->reserved_size = reserve;
+    rel_set(&heap_header(heap)->fresh, (void *) fb_head(heap_header(heap)) + FB_METADATA_SIZE);
+    heap_header(heap)->trim_threshold = MMAP_TRIM_THRESHOLD;
+    heap_header(heap)->large_threshold = MMAP_LARGE_THRESHOLD;
+    return heap;
+}
+
+
+/* Crée un tas partagé entre processus, de size octets, dans le fichier fd (ou une projection anonyme si fd < 0)
+ *
+ * fd peut venir de shm_open ou de memfd_create : le fichier est vidé et mis à la taille du tas, qui n'est jamais
+ * agrandi. Les pages ne sont allouées par le système qu'à leur premier usage.
+ *
+ * Les liens du tas étant relatifs (voir rel_ptr), chaque processus peut le projeter à une adresse différente : les fils
+ * d'un fork en héritent, les autres processus s'y attachent avec mem_heap_attach. Une zone allouée s'y désigne donc par
+ * sa distance au début du tas, pas par son adresse. Toutes les opérations sur le tas prennent un verrou partagé et
+ * robuste, logé dans l'en-tête. Les tas partagés n'ont ni grandes allocations, ni pools, ni arènes.
+ */
+struct mem_heap *mem_heap_create_shared(int fd, size_t size, unsigned flags) {
+    size = align_to_page(size);
+    if (size < sizeof(struct allocator_header) + FB_METADATA_SIZE
+        || (fd >= 0 && (ftruncate(fd, 0) || ftruncate(fd, (off_t) size)))) {
+        return NULL;
+    }
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | (fd < 0 ? MAP_ANONYMOUS : 0), fd, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    struct mem_heap *heap = mem_heap_create(mem, size, flags);
+    struct allocator_header *h = heap_header(heap);
+    bool locked = !pthread_mutex_init(&h->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (!locked) {
+        munmap(mem, size);
+        return NULL;
+    }
+    // Un fichier tout juste agrandi est nul
+    rel_set(&h->fresh, (void *) fb_head(h) + FB_METADATA_SIZE);
+    h->fit_id = 0; // mem_fit_first, choisie par mem_heap_create
+    h->shared = true;
+    return heap;
+}
+
+/* Projette dans ce processus le tas partagé contenu dans fd, à une adresse quelconque
+ *
+ * Renvoie NULL si fd ne contient pas un tas partagé. fd peut être fermé ensuite.
+ */
+struct mem_heap *mem_heap_attach(int fd) {
+    struct allocator_header h;
+    struct stat st;
+    if (pread(fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h) || fstat(fd, &st)
+        || !h.shared || (size_t) st.st_size != h.memory_size || h.fit_id >= NB_SHARED_FITS) {
+        return NULL;
+    }
+    void *mem = mmap(NULL, h.memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+
+/* Oublie un tas
+ *
+ * La mémoire appartient à l'appelant, qui peut la réutiliser dès le retour : toutes les zones encore allouées sont
+ * libérées d'un coup, sans aucun parcours (hormis les grandes allocations, qui ont chacune leur projection). Un tas
+ * extensible rend toute sa réservation au système. Un tas partagé n'est retiré que de ce processus : il reste utilisable
+ * par les autres, et disparaît avec la dernière projection (et le dernier descripteur de son fichier).
+ */
+void mem_heap_destroy(struct mem_heap *heap) {
+    while (heap_header(heap)->large) {
+        profile_on_free(heap_header(heap)->large + 1);
+        large_free(heap_header(heap), heap_header(heap)->large);
+    }
+    profile_forget_range(heap, (void *) heap + heap_header(heap)->memory_size);
+    VALGRIND_DESTROY_MEMPOOL(heap);
+    if ((void *) heap == memory_addr) {
+        memory_addr = NULL;
+    }
+    if (heap_header(heap)->reserved_size) {
+        munmap(heap, heap_header(heap)->reserved_size);
+    } else if (heap_header(heap)->shared) {
+        munmap(heap, heap_header(heap)->memory_size);
+    }
+}
+
+
+size_t mem_heap_memory_size(struct mem_heap *heap) {
+    return heap_header(heap)->memory_size;
+}
+
+
+// Retrouve la plus grande zone libre après la disparition de la précédente, au moindre coût selon l'index
+static size_t largest_free(struct allocator_header *h) {
+    size_t largest = 0;
+    if (h->index == INDEX_TREE) {
+        struct fb *max = rel_get(&h->tree_max);
+        return max ? fb_free_space(max) : 0;
+    } else if (h->index == INDEX_SEGREGATED) {
+        // La plus grande zone est dans la dernière classe non vide
+        size_t c = NB_CLASSES;
+        while (c > 0 && !h->classes[c - 1]) {
+            c--;
+        }
+        for (struct fb *cell = c ? rel_get(&h->classes[c - 1]) : NULL; cell; cell = rel_get(&fb_links(cell)->next)) {
+            largest = fb_free_space(cell) > largest ? fb_free_space(cell) : largest;
+        }
+    } else {
+        for (struct fb *cell = fb_head(h); cell; cell = fb_next(cell)) {
+            FB_VALID_OR(cell, largest);
+            if (fb_counted(cell) && fb_free_space(cell) > largest) {
+                largest = fb_free_space(cell);
+            }
+        }
+    }
+    return largest;
+}
+
+/* Statistiques du tas
+ *
+ * Tout est lu dans des compteurs tenus à jour par les opérations, sans parcours de la chaîne, sauf pour retrouver la
+ * plus grande zone libre si elle a été utilisée depuis le dernier appel : c'est immédiat avec l'arbre des tailles, limité
+ * à une classe avec l'index ségrégué, et un parcours de la chaîne sans index.
+ */
+void mem_heap_stats(struct mem_heap *heap, struct mem_stats *stats) {
+    *stats = (struct mem_stats) {0};
+    HEAP_LOCKED_OR(heap_header(heap), );
+    struct allocator_header *h = heap_header(heap);
+    struct heap_counters *c = &h->counters;
+    if (!c->largest_known) {
+        c->largest_free = largest_free(h);
+        c->largest_known = true;
+    }
+    *stats = (struct mem_stats) {
+        .heap_size = h->memory_size,
+        .in_use = c->in_use,
+        .free = c->free,
+        .largest_free = c->largest_free,
+        .free_zones = c->free_zones,
+        .fragmentation = c->free ? 1.0 - (double) c->largest_free / (double) c->free : 0.0,
+        .allocs = c->allocs,
+        .frees = c->frees,
+        .failed = c->failed,
+        .splits = c->splits,
+        .merges = c->merges,
+        .average_search = c->searches ? (double) c->search_steps / (double) c->searches : 0.0,
+    };
+}
+
+
+void mem_stats(struct mem_stats *stats) {
+    mem_heap_stats(mem_default_heap(), stats);
+}
+
+
+void mem_init_flags(void *mem, size_t taille, unsigned flags) {
+    memory_addr = mem_heap_create(mem, taille, flags);
+    /* On vérifie qu'on a bien enregistré les infos et qu'on
+     * sera capable de les récupérer par la suite
+     */
+    assert(mem == get_system_memory_addr());
+    assert(taille == get_system_memory_size());
+}
+
+
+bool mem_init_mmap(size_t reserve, unsigned flags) {
+    struct mem_heap *heap = mem_heap_create_mmap(reserve, flags);
+    if (heap) {
+        memory_addr = heap;
+    }
+    return heap != NULL;
+}
+
+
+bool mem_init_shared(int fd, size_t size, unsigned flags) {
+    struct mem_heap *heap = mem_heap_create_shared(fd, size, flags);
+    if (heap) {
+        memory_addr = heap;
+    }
+    return heap != NULL;
+}
+
+// Fait du tas partagé projeté en addr (hérité d'un fork, ou obtenu par mem_heap_attach) le tas par défaut
+bool mem_attach(void *addr) {
+    if (!addr || !heap_header(addr)->shared) {
+        return false;
+    }
+    memory_addr = addr;
+    return true;
+}
+
+
+void mem_init(void *mem, size_t taille, bool enable_guards) {
+    mem_init_flags(mem, taille, enable_guards ? MEM_GUARDS : 0);
+}
+
+
+void mem_init_auto(bool enable_guards) {
+    mem_init(get_memory_adr(), get_memory_size(), enable_guards);
+}
+
+
+void mem_heap_show(struct mem_heap *heap, void (*print)(void *, size_t, int)) {
+    HEAP_LOCKED_OR(heap_header(heap), );
+    for (struct fb *free_zone = fb_head(heap_header(heap)); free_zone; free_zone = fb_next(free_zone)) {
+        struct fb *next = fb_next(free_zone);
+        print(free_zone, free_zone->size, true);
+        if (next) {
+            print(((void *) free_zone) + free_zone->size, ((void *) next) - ((void *) free_zone) - free_zone->size,
+                  false);
+        }
+    }
+}
+
+
+void mem_show(void (*print)(void *, size_t, int)) {
+    mem_heap_show(mem_default_heap(), print);
+}
+
+
+void align_correctly(size_t *val) {
+    size_t x = *val % (size_t) ALIGNMENT;
+    *val += x ? ALIGNMENT - x : 0;
+}
+
+
+static void deferred_flush(struct allocator_header *h);
+
+/* Zone libre d'au moins search_size octets choisie par la stratégie
+ *
+ * En dernier recours, le tas est agrandi de grow_size octets si possible (d'une quantité suffisante pour plusieurs
+ * zones, pour une allocation groupée), sinon de search_size.
+ */
+static struct fb *heap_find(struct allocator_header *h, size_t search_size, size_t grow_size) {
+    struct fb *fb = heap_fit(h)(fb_head(h), search_size);
+    h->counters.searches++;
+    if (!fb && h->deferred_bytes) {
+        // Les zones en attente de fusion peuvent suffire une fois fusionnées
+        deferred_flush(h);
+        fb = heap_fit(h)(fb_head(h), search_size);
+        h->counters.searches++;
+    }
+    if (!fb && (heap_grow(h, grow_size) || (grow_size > search_size && heap_grow(h, search_size)))) {
+        fb = heap_fit(h)(fb_head(h), search_size);
+        h->counters.searches++;
+    }
+    return fb;
+}
+
+// Place autour de requested_size octets pour une zone allouée : tag et gardes
+static inline size_t block_span(struct allocator_header *h, size_t requested_size) {
+    return block_prefix(h) + requested_size + (h->guards_enabled ? sizeof(guard) : 0);
+}
+
+// Écrit le tag et les gardes de la zone allouée qui commence en block, après le fb cell, et renvoie son adresse utile
+static void *block_setup(struct allocator_header *h, struct fb *cell, void *block, size_t requested_size) {
+    if (h->tags_enabled) {
+        struct tag *tag = block;
+        rel_set(&tag->fb, cell);
+        tag->size = requested_size | TAG_IN_USE;
+        block += sizeof(struct tag);
+    }
+    if (h->guards_enabled) {
+        *((guard*) block) = GUARD_VALUE;
+        block += sizeof(guard);
+        *((guard*) (block + requested_size)) = GUARD_VALUE;
+    }
+    return block;
+}
+
+/* Découpe dans la chaîne une zone de requested_size octets, dont l'adresse donnée à l'utilisateur est alignée sur align
+ *
+ * La zone est placée au début de la zone libre choisie par la stratégie, décalée si besoin pour l'alignement : le fb
+ * de la zone libre ne bouge pas et garde alors l'espace qui précède. Les compteurs et valgrind sont à la charge de
+ * l'appelant.
+ */
+static void *heap_carve(struct allocator_header *h, size_t requested_size, size_t align) {
+    size_t prefix = block_prefix(h);
+    size_t actual_size = block_span(h, requested_size);
+    // Au pire, l'alignement décale la zone de align - ALIGNMENT octets
+    size_t search_size = actual_size + align - ALIGNMENT;
+
+    struct fb *fb = heap_find(h, search_size, search_size);
+    if (!fb) {
+        return NULL;
+    }
+
+    void *block = (void *) fb + sizeof(struct fb);
+    block += (align - ((uintptr_t) (block + prefix) % align)) % align;
+
+    index_remove(h, fb);
+    struct fb *new_fb = block + actual_size;
+    new_fb->size = (void *) fb + fb->size - (void *) new_fb;
+    fb_set_next(new_fb, fb_next(fb));
+    index_insert(h, new_fb);
+    tag_adopt(h, new_fb);
+
+    fb->size = block - (void *) fb;
+    fb_set_next(fb, new_fb);
+    index_insert(h, fb);
+    rel_set(&h->rover, new_fb);
+    h->counters.splits++;
+    return block_setup(h, fb, block, requested_size);
+}
+
+
+/* Découpe jusqu'à n zones de requested_size octets dans une même zone libre, et renvoie leur nombre (nul si le tas est
+ * plein)
+ *
+ * Les zones sont placées à la suite les unes des autres, chacune précédée d'un fb sans espace libre, comme si elles
+ * avaient été découpées une par une : la zone libre n'est cherchée, retirée de l'index et réinsérée qu'une fois.
+ */
+static size_t heap_carve_batch(struct allocator_header *h, size_t requested_size, size_t n, void **out) {
+    size_t actual_size = block_span(h, requested_size);
+    size_t stride = actual_size + sizeof(struct fb);
+    size_t grow_size;
+    if (__builtin_mul_overflow(n, stride, &grow_size)) {
+        grow_size = actual_size;
+    }
+    struct fb *fb = heap_find(h, actual_size, grow_size);
+    if (!fb) {
+        return 0;
+    }
+
+    // k zones et leurs fb occupent k * stride octets après le fb de la zone libre, qui doit en garder un à la fin
+    size_t count = (fb_free_space(fb) + sizeof(struct fb)) / stride;
+    count = count < n ? count : n;
+    void *end = (void *) fb + fb->size;
+    struct fb *next = fb_next(fb);
+    index_remove(h, fb);
+    struct fb *cell = fb;
+    for (size_t i = 0; i < count; i++) {
+        void *block = (void *) cell + sizeof(struct fb);
+        struct fb *following = block + actual_size;
+        out[i] = block_setup(h, cell, block, requested_size);
+        cell->size = sizeof(struct fb);
+        fb_set_next(cell, following);
+        index_insert(h, cell);
+        cell = following;
+    }
+    cell->size = end - (void *) cell;
+    fb_set_next(cell, next);
+    index_insert(h, cell);
+    tag_adopt(h, cell);
+    rel_set(&h->rover, cell);
+    h->counters.splits++;
+    return count;
+}
+
+
+/* Slabs des petits objets (MEM_SLABS)
+ *
+ * Les allocations d'au plus SLAB_MAX_SIZE octets sont servies par des slabs : des zones de SLAB_SIZE octets alignées
+ * sur leur taille, prises dans la chaîne comme n'importe quelle allocation, et découpées en objets d'une seule classe
+ * (un multiple de ALIGNMENT). Un objet n'a ni fb, ni tag, ni garde : son slab se retrouve en arrondissant son adresse,
+ * et un bitmap dans l'en-tête du slab indique les objets libres.
+ *
+ * Chaque classe a la liste des slabs qui ont des objets libres. Un slab vidé est rendu à la chaîne, sauf si c'est le
+ * dernier de sa classe, pour ne pas en recréer un à l'allocation suivante.
+ */
+
+struct slab {
+    uint64_t magic;         // avec heap, dont la valeur dépend de la place du slab, le distingue de données quelconques
+    rel_ptr heap;
+    rel_ptr prev;           // liste des slabs de la classe qui ont des objets libres
+    rel_ptr next;
+    uint32_t object_size;
+    uint32_t capacity;
+    uint32_t used;
+    uint64_t free_map[SLAB_MAP_WORDS]; // un bit à 1 par objet libre
+} __attribute__ ((aligned (ALIGNMENT)));
+
+static inline void *slab_object(struct slab *slab, size_t i) {
+    return (void *) (slab + 1) + i * slab->object_size;
+}
+
+// Le slab qui contient ptr, ou NULL si ptr n'est pas un objet d'un slab de ce tas
+static struct slab *slab_of(struct allocator_header *h, void *ptr) {
+    if (!h->slabs_enabled) {
+        return NULL;
+    }
+    struct slab *slab = (struct slab *) ((uintptr_t) ptr & ~(SLAB_SIZE - 1));
+    uintptr_t offset = (uintptr_t) slab - (uintptr_t) fb_head(h);
+    if (offset >= h->memory_size - sizeof(struct allocator_header) - sizeof(struct slab)) {
+        return NULL;
+    }
+    if (slab->magic != SLAB_MAGIC || rel_get(&slab->heap) != h) {
+        return NULL;
+    }
+    return slab;
+}
+
+static inline void slab_link(struct allocator_header *h, struct slab *slab) {
+    rel_ptr *list = &h->slabs[slab->object_size / ALIGNMENT - 1];
+    struct slab *next = rel_get(list);
+    rel_set(&slab->prev, NULL);
+    rel_set(&slab->next, next);
+    if (next) {
+        rel_set(&next->prev, slab);
+    }
+    rel_set(list, slab);
+}
+
+static inline void slab_unlink(struct allocator_header *h, struct slab *slab) {
+    struct slab *prev = rel_get(&slab->prev);
+    struct slab *next = rel_get(&slab->next);
+    if (prev) {
+        rel_set(&prev->next, next);
+    } else {
+        rel_set(&h->slabs[slab->object_size / ALIGNMENT - 1], next);
+    }
+    if (next) {
+        rel_set(&next->prev, prev);
+    }
+}
+
+static struct slab *slab_new(struct allocator_header *h, size_t object_size) {
+    struct slab *slab = heap_carve(h, SLAB_SIZE - block_prefix(h), SLAB_SIZE);
+    if (!slab) {
+        return NULL;
+    }
+    // Le tag de la zone est juste avant le slab : le slab commence bien sur une frontière de SLAB_SIZE
+    *slab = (struct slab) {
+        .magic = SLAB_MAGIC,
+        .object_size = object_size,
+        .capacity = (SLAB_SIZE - block_prefix(h) - sizeof(struct slab)) / object_size,
+    };
+    rel_set(&slab->heap, h);
+    for (size_t i = 0; i < slab->capacity; i++) {
+        slab->free_map[i / 64] |= (uint64_t) 1 << (i % 64);
+    }
+    slab_link(h, slab);
+    return slab;
+}
+
+static void *slab_alloc(struct allocator_header *h, size_t object_size) {
+    struct slab *slab = rel_get(&h->slabs[object_size / ALIGNMENT - 1]);
+    if (!slab && !(slab = slab_new(h, object_size))) {
+        return NULL;
+    }
+    size_t word = 0;
+    while (!slab->free_map[word]) {
+        word++;
+    }
+    size_t i = word * 64 + __builtin_ctzll(slab->free_map[word]);
+    slab->free_map[word] &= ~((uint64_t) 1 << (i % 64));
+    if (++slab->used == slab->capacity) {
+        slab_unlink(h, slab);
+    }
+    return slab_object(slab, i);
+}
+
+// Indice de l'objet ptr dans son slab, ou -1 (et LAST_ERROR) si ce n'est pas un objet alloué
+static ssize_t slab_index(struct slab *slab, void *ptr) {
+    size_t offset = ptr - slab_object(slab, 0);
+    size_t i = offset / slab->object_size;
+    if (ptr < slab_object(slab, 0) || offset % slab->object_size || i >= slab->capacity
+        || (slab->free_map[i / 64] & ((uint64_t) 1 << (i % 64)))) {
+        set_error_code(NOT_ALLOCATED);
+        return -1;
+    }
+    return (ssize_t) i;
+}
+
+static struct fb *find_block(struct allocator_header *h, void *mem);
+static void heap_release(struct allocator_header *h, struct fb *cell);
+static bool deferred_push(struct allocator_header *h, void *mem, size_t size);
+static void *deferred_pop(struct allocator_header *h, size_t size);
+
+static bool slab_free(struct allocator_header *h, struct slab *slab, void *ptr) {
+    ssize_t i = slab_index(slab, ptr);
+    if (i < 0) {
+        return false;
+    }
+    slab->free_map[i / 64] |= (uint64_t) 1 << (i % 64);
+    if (slab->used-- == slab->capacity) {
+        slab_link(h, slab);
+    }
+    if (!slab->used && (slab->prev || slab->next)) {
+        slab_unlink(h, slab);
+        // La mémoire redevient quelconque : elle ne doit plus être prise pour un slab
+        slab->magic = 0;
+        heap_release(h, find_block(h, slab));
+    }
+    return true;
+}
+
+
+// Comptabilise une zone qui vient d'être allouée (ou l'échec de l'allocation si allocated est nul)
+static void *account_alloc(struct allocator_header *h, void *allocated, size_t requested_size) {
+    if (!allocated) {
+        h->counters.failed++;
+        return NULL;
+    }
+    h->counters.allocs++;
+    h->counters.in_use += requested_size;
+    profile_on_alloc(allocated, requested_size);
+    VALGRIND_MEMPOOL_ALLOC(h, allocated, requested_size);
+    return allocated;
+}
+
+
+void *mem_heap_alloc(struct mem_heap *heap, size_t requested_size) {
+    HEAP_LOCKED_OR(heap_header(heap), NULL);
+    struct allocator_header *h = heap_header(heap);
+#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
+    if (requested_size == 0) {
+        // On peut retourner n'importe quel pointeur mais pour éviter les UB, il faut qu'il soit non-nul et aligné à la
+        // taille d'un registre. Ce cas sera géré dans `mem_free`.
+        return fb_head(h);
+    }
+#endif
+
+    if (requested_size > MAX_REQUEST_SIZE) {
+        h->counters.failed++;
+        return NULL;
+    }
+    // On aligne, c'est plus prudent, car cela garantit que tous les fb sont alignés (le contraire serait
+    // potentiellement problématique sur certaines architectures).
+    align_correctly(&requested_size);
+
+    if (h->large_threshold && requested_size >= h->large_threshold) {
+        void *large = large_alloc(h, requested_size);
+        if (large) {
+            h->counters.allocs++;
+            profile_on_alloc(large, requested_size);
+        } else {
+            h->counters.failed++;
+        }
+        return large;
+    }
+
+    void *allocated;
+    if (h->slabs_enabled && requested_size <= SLAB_MAX_SIZE) {
+        requested_size = requested_size ? requested_size : ALIGNMENT;
+        allocated = slab_alloc(h, requested_size);
+    } else if (!h->deferred_bytes || !(allocated = deferred_pop(h, requested_size))) {
+        allocated = heap_carve(h, requested_size, ALIGNMENT);
+    }
+    return account_alloc(h, allocated, requested_size);
+}
+
+
+void *mem_alloc(size_t size) {
+    return mem_heap_alloc(mem_default_heap(), size);
+}
+
+
+/* Alloue une zone de count * size octets mis à zéro
+ *
+ * Seule la partie de la zone qui a déjà servi est effacée : une grande allocation sort tout juste de mmap, et dans un
+ * tas extensible, la mémoire au-delà de h->fresh n'a jamais été touchée depuis sa projection.
+ */
+void *mem_heap_calloc(struct mem_heap *heap, size_t count, size_t size) {
+    HEAP_LOCKED_OR(heap_header(heap), NULL);
+    struct allocator_header *h = heap_header(heap);
+    size_t total;
+    if (__builtin_mul_overflow(count, size, &total)) {
+        h->counters.failed++;
+        return NULL;
+    }
+    void *fresh = rel_get(&h->fresh);
+    void *zone = mem_heap_alloc(heap, total);
+    if (!zone || !heap_contains(h, zone) || zone >= fresh) {
+        return zone;
+    }
+    size_t used = (size_t) (fresh - zone);
+    memset(zone, 0, used < total ? used : total);
+    return zone;
+}
+
+
+void *mem_calloc(size_t count, size_t size) {
+    return mem_heap_calloc(mem_default_heap(), count, size);
+}
+
+
+/* Alloue une zone de size octets dont l'adresse est un multiple de align (une puissance de deux)
+ *
+ * Au-delà de ALIGNMENT, la zone est découpée à l'endroit aligné de la zone libre choisie : l'espace qui la précède
+ * reste à la zone libre et sert aux allocations suivantes. Elle est prise dans la chaîne même au-delà du seuil des
+ * grandes allocations, dont les projections ne peuvent pas être alignées plus que leur en-tête.
+ */
+void *mem_heap_alloc_aligned(struct mem_heap *heap, size_t size, size_t align) {
+    HEAP_LOCKED_OR(heap_header(heap), NULL);
+    struct allocator_header *h = heap_header(heap);
+    if (!align || (align & (align - 1))) {
+        return NULL;
+    }
+    if (align <= ALIGNMENT) {
+        return mem_heap_alloc(heap, size);
+    }
+#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
+    if (size == 0) {
+        // Comme dans mem_heap_alloc : la zone vide n'a pas d'adresse propre, quel que soit l'alignement demandé
+        return mem_heap_alloc(heap, 0);
+    }
+#endif
+
+    // Avec ces bornes, la recherche d'une zone de size + align octets ne déborde pas
+    if (size > MAX_REQUEST_SIZE || align > MAX_REQUEST_SIZE) {
+        h->counters.failed++;
+        return NULL;
+    }
+    align_correctly(&size);
+    return account_alloc(h, heap_carve(h, size, align), size);
+}
+
+
+void *mem_alloc_aligned(size_t size, size_t align) {
+    return mem_heap_alloc_aligned(mem_default_heap(), size, align);
+}
+
+
+/* Alloue n zones de size octets, placées dans out, et renvoie le nombre de zones obtenues
+ *
+ * Il est inférieur à n seulement si le tas est plein, les zones obtenues restant alors à libérer. Chaque zone libre
+ * trouvée par la stratégie est découpée en autant de zones qu'elle peut en contenir, au lieu d'une recherche par zone.
+ * Les petits objets des slabs et les grandes allocations n'ont pas de recherche à éviter : ils sont alloués un par un.
+ */
+size_t mem_heap_alloc_batch(struct mem_heap *heap, size_t size, size_t n, void **out) {
+    HEAP_LOCKED_OR(heap_header(heap), 0);
+    struct allocator_header *h = heap_header(heap);
+    if (size > MAX_REQUEST_SIZE) {
+        h->counters.failed += n ? 1 : 0;
+        return 0;
+    }
+    align_correctly(&size);
+    bool one_by_one = (h->large_threshold && size >= h->large_threshold) || (h->slabs_enabled && size <= SLAB_MAX_SIZE);
+#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
+    one_by_one = one_by_one || !size;
+#endif
+    size_t done = 0;
+    if (one_by_one) {
+        while (done < n && (out[done] = mem_heap_alloc(heap, size))) {
+            done++;
+        }
+        return done;
+    }
+
+    while (done < n) {
+        void *zone = h->deferred_bytes ? deferred_pop(h, size) : NULL;
+        if (zone) {
+            out[done++] = account_alloc(h, zone, size);
+            continue;
+        }
+        size_t carved = heap_carve_batch(h, size, n - done, out + done);
+        if (!carved) {
+            account_alloc(h, NULL, size);
+            break;
+        }
+        for (size_t i = done; i < done + carved; i++) {
+            account_alloc(h, out[i], size);
+        }
+        done += carved;
+    }
+    return done;
+}
+
+
+size_t mem_alloc_batch(size_t size, size_t n, void **out) {
+    return mem_heap_alloc_batch(mem_default_heap(), size, n, out);
+}
+
+
+/* Retrouve le fb qui précède la zone allouée dont l'utilisateur a reçu le pointeur mem
+ *
+ * Avec les boundary tags, c'est immédiat : on vérifie seulement que le tag est cohérent. Sinon, on parcourt la chaîne.
+ * Renvoie NULL (et positionne LAST_ERROR) si mem ne correspond à aucune zone allouée.
+ */
+static struct fb *find_block(struct allocator_header *h, void *mem) {
+    void *block = mem - block_prefix(h);
+
+    if (h->tags_enabled) {
+        // On ne lit le tag que s'il est dans le tas, le pointeur pouvant être n'importe quoi (calcul non signé pour
+        // ne pas se faire piéger par un dépassement, avec NULL par exemple)
+        uintptr_t offset = (uintptr_t) block - (uintptr_t) fb_head(h);
+        size_t heap_size = h->memory_size - sizeof(struct allocator_header);
+        if (offset >= sizeof(struct fb) && offset <= heap_size - sizeof(struct tag)
+            && (((struct tag *) block)->size & TAG_IN_USE)) {
+            struct fb *cell = rel_get(&((struct tag *) block)->fb);
+            if ((void *) cell >= (void *) fb_head(h) && (void *) cell < block && (void *) cell + cell->size == block) {
+                return cell;
+            }
+        }
+    } else {
+        for (struct fb *cell = fb_head(h); cell; cell = fb_next(cell)) {
+            // détection de chaînages invalides causés par un écrasement des données de l'allocateur
+            FB_VALID_OR(cell, NULL);
+            if (((void *) cell) + cell->size == block) {
+                return cell;
+            }
+        }
+    }
+
+    set_error_code(NOT_ALLOCATED);
+    return NULL;
+}
+
+
+// Taille utile de la zone allouée qui suit le fb cell
+static size_t block_size(struct allocator_header *h, struct fb *cell) {
+    if (h->tags_enabled) {
+        return ((struct tag *) ((void *) cell + cell->size))->size & ~TAG_IN_USE;
+    }
+    // Ne devrait pas être nul si la mémoire est dans un état valide et que la zone a été trouvée
+    struct fb *next = fb_next(cell);
+    return ((void *) next) - ((void *) cell) - cell->size - (h->guards_enabled ? 2 * sizeof(guard) : 0);
+}
+
+
+// Libération d'une grande allocation, déjà validée
+static void large_release(struct allocator_header *h, struct large_block *large) {
+    profile_on_free(large + 1);
+    large_free(h, large);
+    h->counters.frees++;
+}
+
+static bool slab_release(struct allocator_header *h, struct slab *slab, void *mem) {
+    size_t object_size = slab->object_size;
+    if (!slab_free(h, slab, mem)) {
+        return false;
+    }
+    h->counters.frees++;
+    h->counters.in_use -= object_size;
+    profile_on_free(mem);
+    VALGRIND_MEMPOOL_FREE(h, mem);
+    return true;
+}
+
+// Libération d'une zone de la chaîne des fb
+// Vérifie les gardes de part et d'autre de la zone allouée mem, qui suit le fb cell
+static bool guards_intact(struct allocator_header *h, struct fb *cell, void *mem) {
+    if (h->guards_enabled && (((guard*) mem)[-1] != GUARD_VALUE || ((guard*) fb_next(cell))[-1] != GUARD_VALUE)) {
+        set_error_code(GUARD_VIOLATION);
+        return false;
+    }
+    return true;
+}
+
+// Libération de la zone allouée qui suit le fb cell, déjà retrouvée
+static bool cell_release(struct allocator_header *h, struct fb *cell, void *mem) {
+    if (!guards_intact(h, cell, mem)) {
+        return false;
+    }
+    size_t size = block_size(h, cell);
+    h->counters.frees++;
+    h->counters.in_use -= size;
+    profile_on_free(mem);
+    if (!deferred_push(h, mem, size)) {
+        heap_release(h, cell);
+        VALGRIND_MEMPOOL_FREE(h, mem);
+    }
+    return true;
+}
+
+static bool block_release(struct allocator_header *h, void *mem) {
+    struct fb *cell = find_block(h, mem);
+    if (!cell) {
+        return false; // on essaie de libérer une zone mémoire non allouée
+    }
+    return cell_release(h, cell, mem);
+}
+
+bool mem_heap_free(struct mem_heap *heap, void *mem) {
+    HEAP_LOCKED_OR(heap_header(heap), false);
+    struct allocator_header *h = heap_header(heap);
+#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
+    if (mem == fb_head(h)) {
+        // Special case of `mem_alloc(0)`
+        return true;
+    }
+#endif
+
+    if (h->large && !heap_contains(h, mem)) {
+        struct large_block *large = large_find(h, mem);
+        if (large) {
+            large_release(h, large);
+        }
+        return large != NULL;
+    }
+
+    struct slab *slab = slab_of(h, mem);
+    if (slab) {
+        return slab_release(h, slab, mem);
+    }
+    return block_release(h, mem);
+}
+
+/* Libération d'une zone dont l'appelant connaît la taille demandée (free_sized de C23, dealloc de Rust)
+ *
+ * La taille dit d'emblée où chercher la zone : on ne regarde si elle est dans un slab que pour les tailles des slabs.
+ * Comme pour free_sized, une taille fausse n'est pas détectée en temps normal. Avec l'option MEM_SIZE_CHECKS, elle est
+ * comparée à la taille de la zone, lue sur le slab, la grande allocation ou le fb déjà retrouvés (sans recherche
+ * supplémentaire), et la libération est refusée (erreur SIZE_MISMATCH) si elles diffèrent.
+ */
+static inline bool size_matches(struct allocator_header *h, size_t expected, size_t size) {
+    if (h->size_checks_enabled && size != expected) {
+        set_error_code(SIZE_MISMATCH);
+        return false;
+    }
+    return true;
+}
+
+bool mem_heap_free_sized(struct mem_heap *heap, void *mem, size_t size) {
+    HEAP_LOCKED_OR(heap_header(heap), false);
+    struct allocator_header *h = heap_header(heap);
+#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
+    if (mem == fb_head(h)) {
+        // Special case of `mem_alloc(0)`
+        return true;
+    }
+#endif
+    align_correctly(&size);
+
+    if (!heap_contains(h, mem)) {
+        struct large_block *large = h->large ? large_find(h, mem) : NULL;
+        if (!large) {
+            set_error_code(NOT_ALLOCATED);
+            return false;
+        }
+        if (!size_matches(h, large->size, size)) {
+            return false;
+        }
+        large_release(h, large);
+        return true;
+    }
+    if (size <= SLAB_MAX_SIZE || h->size_checks_enabled) {
+        struct slab *slab = slab_of(h, mem);
+        if (slab) {
+            // Une demande de taille nulle prend un objet de slab entier
+            if (!size_matches(h, slab->object_size, size ? size : ALIGNMENT)) {
+                return false;
+            }
+            return slab_release(h, slab, mem);
+        }
+    }
+    struct fb *cell = find_block(h, mem);
+    if (!cell || !size_matches(h, block_size(h, cell), size)) {
+        return false;
+    }
+    return cell_release(h, cell, mem);
+}
+
+
+// Rend à la chaîne la zone allouée qui suit le fb cell, en la fusionnant avec ses voisines libres
+static void heap_release(struct allocator_header *h, struct fb *cell) {
+    if (h->tags_enabled) {
+        // Permet de détecter les doubles libérations
+        ((struct tag *) ((void *) cell + cell->size))->size = 0;
+    }
+
+    struct fb *next = fb_next(cell);
+    void *freed = (void *) cell + cell->size;
+    index_remove(h, cell);
+    index_remove(h, next);
+    cell->size = (size_t) ((void *) next - ((void *) cell)) + next->size;
+    fb_set_next(cell, fb_next(next));
+    fb_absorbed(h, next, cell);
+    index_insert(h, cell);
+    tag_adopt(h, cell);
+    // Le fb qui suivait la zone libérée fait désormais partie de la mémoire libre
+    trim_free(h, cell, freed, (void *) next + FB_METADATA_SIZE);
+    h->counters.merges++;
+}
+
+
+/* Libérations différées
+ *
+ * Une libération fusionne aussitôt la zone avec la zone libre qui la suit, et l'allocation suivante de même taille
+ * redécoupe souvent la même zone. En mode différé, une zone d'au plus DEFER_MAX_SIZE octets reste allouée du point de
+ * vue de la chaîne : son tag perd seulement le bit d'occupation (une double libération reste détectée) mais son fb
+ * y est toujours tenu à jour, et elle rejoint la liste de sa taille exacte, chaînée par son premier mot. La prochaine
+ * allocation de cette taille la reprend sans recherche ni découpe. Comme les fastbins de dlmalloc, les zones en
+ * attente sont fusionnées toutes ensemble quand elles dépassent le budget, quand une recherche de zone libre échoue,
+ * ou quand le mode est désactivé.
+ *
+ * Pour valgrind, une zone en attente est toujours allouée.
+ */
+
+struct deferred_zone {
+    rel_ptr next;
+};
+
+static inline struct tag *deferred_tag(struct allocator_header *h, struct deferred_zone *zone) {
+    return (struct tag *) ((void *) zone - block_prefix(h));
+}
+
+static void deferred_flush(struct allocator_header *h) {
+    for (size_t c = 0; c < DEFER_CLASSES; c++) {
+        while (h->deferred[c]) {
+            struct deferred_zone *zone = rel_get(&h->deferred[c]);
+            rel_set(&h->deferred[c], rel_get(&zone->next));
+            heap_release(h, rel_get(&deferred_tag(h, zone)->fb));
+            VALGRIND_MEMPOOL_FREE(h, zone);
+        }
+    }
+    h->deferred_bytes = 0;
+}
+
+static bool deferred_push(struct allocator_header *h, void *mem, size_t size) {
+    if (!h->defer_budget || !size || size > DEFER_MAX_SIZE) {
+        return false;
+    }
+    struct deferred_zone *zone = mem;
+    deferred_tag(h, zone)->size = size;
+    rel_set(&zone->next, rel_get(&h->deferred[size / ALIGNMENT - 1]));
+    rel_set(&h->deferred[size / ALIGNMENT - 1], zone);
+    h->deferred_bytes += size;
+    if (h->deferred_bytes > h->defer_budget) {
+        deferred_flush(h);
+    }
+    return true;
+}
+
+static void *deferred_pop(struct allocator_header *h, size_t size) {
+    if (!size || size > DEFER_MAX_SIZE || !h->deferred[size / ALIGNMENT - 1]) {
+        return NULL;
+    }
+    struct deferred_zone *zone = rel_get(&h->deferred[size / ALIGNMENT - 1]);
+    rel_set(&h->deferred[size / ALIGNMENT - 1], rel_get(&zone->next));
+    deferred_tag(h, zone)->size = size | TAG_IN_USE;
+    h->deferred_bytes -= size;
+    VALGRIND_MEMPOOL_FREE(h, zone); // l'appelant la déclare de nouveau allouée
+    return zone;
+}
+
+/* Active les libérations différées : jusqu'à budget octets de petites zones libérées attendent d'être fusionnées
+ *
+ * Un budget nul désactive le mode, en fusionnant les zones en attente. Nécessite les boundary tags : renvoie faux sans.
+ */
+bool mem_heap_defer_frees(struct mem_heap *heap, size_t budget) {
+    HEAP_LOCKED_OR(heap_header(heap), false);
+    struct allocator_header *h = heap_header(heap);
+    if (!h->tags_enabled) {
+        return false;
+    }
+    h->defer_budget = budget;
+    if (h->deferred_bytes > budget) {
+        deferred_flush(h);
+    }
+    return true;
+}
+
+
+bool mem_free(void *mem) {
+    return mem_heap_free(mem_default_heap(), mem);
+}
+
+bool mem_free_sized(void *mem, size_t size) {
+    return mem_heap_free_sized(mem_default_heap(), mem, size);
+}
+
+
+static void sift_down(void **ptrs, size_t root, size_t n) {
+    for (size_t child; (child = 2 * root + 1) < n; root = child) {
+        if (child + 1 < n && (uintptr_t) ptrs[child + 1] > (uintptr_t) ptrs[child]) {
+            child++;
+        }
+        if ((uintptr_t) ptrs[root] >= (uintptr_t) ptrs[child]) {
+            return;
+        }
+        void *tmp = ptrs[root];
+        ptrs[root] = ptrs[child];
+        ptrs[child] = tmp;
+    }
+}
+
+// Tri par tas des adresses, en place et sans allocation (qsort peut appeler malloc)
+static void sort_addresses(void **ptrs, size_t n) {
+    for (size_t i = n / 2; i-- > 0;) {
+        sift_down(ptrs, i, n);
+    }
+    for (size_t end = n; end-- > 1;) {
+        void *max = ptrs[0];
+        ptrs[0] = ptrs[end];
+        ptrs[end] = max;
+        sift_down(ptrs, 0, end);
+    }
+}
 
-   Elle contient toutes les variables globales nécessaires au
-   fonctionnement de l'allocateur
+/* Libère les n zones de ptrs (NULL est ignoré), et renvoie faux si l'une d'elles n'a pas pu l'être
+ *
+ * Le tableau est trié par adresse, ce qui permet de retrouver les zones en un seul parcours de la chaîne quand il n'y a
+ * pas de tags. Des zones qui se suivent dans la chaîne sont fusionnées d'un coup, avec une seule mise à jour de
+ * l'index. Comme pour mem_heap_free, une zone invalide est signalée par LAST_ERROR, et les autres sont libérées.
+ */
+bool mem_heap_free_batch(struct mem_heap *heap, void **ptrs, size_t n) {
+    HEAP_LOCKED_OR(heap_header(heap), false);
+    struct allocator_header *h = heap_header(heap);
+    size_t prefix = block_prefix(h);
+    bool ok = true;
+    sort_addresses(ptrs, n);
 
-   Elle peut bien évidemment être complétée
-*/
-struct allocator_header {
-    size_t memory_size;
-    mem_fit_function_t *fit;
-    bool guards_enabled;
-} __attribute__ ((aligned (16))); // Essentiel au bon fonctionnement de l'allocateur
+    struct fb *cursor = fb_head(h); // parcours de la chaîne, sans tags
+    for (size_t i = 0; i < n;) {
+        void *mem = ptrs[i];
+        if (!mem) {
+            i++;
+            continue;
+        }
+        if (!heap_contains(h, mem) || slab_of(h, mem)) {
+            ok = mem_heap_free(heap, mem) && ok;
+            i++;
+            continue;
+        }
+#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
+        if (mem == fb_head(h)) {
+            i++;
+            continue;
+        }
+#endif
 
+        void *block = mem - prefix;
+        struct fb *cell;
+        if (h->tags_enabled) {
+            cell = find_block(h, mem);
+        } else {
+            while (fb_next(cursor) && (void *) fb_next(cursor) < block) {
+                FB_VALID_OR(cursor, false);
+                cursor = fb_next(cursor);
+            }
+            cell = (void *) cursor + cursor->size == block ? cursor : NULL;
+            if (!cell) {
+                set_error_code(NOT_ALLOCATED);
+            }
+        }
+        if (!cell || !guards_intact(h, cell, mem)) {
+            ok = false;
+            i++;
+            continue;
+        }
 
-/* La seule variable globale autorisée
- * On trouve à cette adresse le début de la zone à gérer
- * (et une structure 'struct allocator_header)
- */
-static void *memory_addr;
+        // Fusion de la zone, puis des zones suivantes du lot tant qu'elles suivent directement la zone libre obtenue
+        void *start = block;
+        struct fb *next;
+        index_remove(h, cell);
+        for (;;) {
+            size_t size = block_size(h, cell);
+            h->counters.frees++;
+            h->counters.in_use -= size;
+            h->counters.merges++;
+            profile_on_free(mem);
+            VALGRIND_MEMPOOL_FREE(h, mem);
+            if (h->tags_enabled) {
+                ((struct tag *) block)->size = 0;
+            }
+            next = fb_next(cell);
+            index_remove(h, next);
+            cell->size = (size_t) ((void *) next - (void *) cell) + next->size;
+            fb_set_next(cell, fb_next(next));
+            fb_absorbed(h, next, cell);
+            i++;
 
-static inline void *get_system_memory_addr() {
-    return memory_addr;
+            block = (void *) cell + cell->size;
+            if (i == n || !fb_next(cell) || ptrs[i] != block + prefix) {
+                break;
+            }
+            mem = ptrs[i];
+            if (h->tags_enabled && !(((struct tag *) block)->size & TAG_IN_USE)) {
+                break; // zone en attente de fusion, ou déjà libre : l'erreur sera signalée au tour suivant
+            }
+            if (!guards_intact(h, cell, mem)) {
+                ok = false;
+                i++;
+                break;
+            }
+        }
+        index_insert(h, cell);
+        tag_adopt(h, cell);
+        trim_free(h, cell, start, (void *) next + FB_METADATA_SIZE);
+    }
+    return ok;
 }
 
-static inline struct allocator_header *get_header() {
-    struct allocator_header *h;
-    h = get_system_memory_addr();
-    return h;
+bool mem_free_batch(void **ptrs, size_t n) {
+    return mem_heap_free_batch(mem_default_heap(), ptrs, n);
 }
 
-static inline struct fb *get_fb_head() {
-    return (struct fb *) (get_system_memory_addr() + sizeof(struct allocator_header));
-}
 
-static inline size_t get_system_memory_size() {
-    return get_header()->memory_size;
+// Première zone libre suffisante de la chaîne du tas h, de from jusqu'à stop exclu
+static struct fb *fit_first_between(struct allocator_header *h, struct fb *from, struct fb *stop, size_t size) {
+    size_t *steps = &h->counters.search_steps;
+    for (struct fb *cell = from; cell != stop; cell = fb_next(cell)) {
+        // détection de chaînages invalides causés par un écrasement des données de l'allocateur
+        FB_VALID_OR(cell, NULL);
+        (*steps)++;
+        ssize_t free_space = (ssize_t) cell->size - (ssize_t) 2 * (ssize_t) sizeof(struct fb);
+        if ((ssize_t) size <= free_space) {
+            return cell;
+        }
+    }
+
+    return NULL;
 }
 
-void mem_fit(mem_fit_function_t *f) {
-    get_header()->fit = f;
+struct fb *mem_fit_first(struct fb *list, size_t size) {
+    return fit_first_between(header_of(list), list, NULL, size);
 }
 
-void mem_size(size_t size) {
-    get_header()->memory_size = size;
+/* Next fit : first fit qui reprend là où la dernière allocation s'est arrêtée
+ *
+ * Le parcours part de la zone libre qui suit la dernière zone découpée, va jusqu'à la fin de la chaîne, puis reprend
+ * au début. Les petits restes du début du tas ne sont donc plus réexaminés à chaque allocation.
+ */
+struct fb *mem_fit_next(struct fb *list, size_t size) {
+    struct allocator_header *h = header_of(list);
+    struct fb *rover = rel_get(&h->rover);
+    if (!rover) {
+        return fit_first_between(h, list, NULL, size);
+    }
+    struct fb *found = fit_first_between(h, rover, NULL, size);
+    return found ? found : fit_first_between(h, list, rover, size);
 }
 
-// Voir nos schémas pour comprendre notre utilisation de fb
-struct fb {
-    size_t size;
-    struct fb *next;
-};
+/* Fonction à faire dans un second temps
+ * - utilisée par realloc() dans malloc_stub.c
+ * - nécessaire pour remplacer l'allocateur de la libc
+ * - donc nécessaire pour 'make test_ls'
+ * Lire malloc_stub.c pour comprendre son utilisation
+ * (ou en discuter avec l'enseignant)
+ */
+size_t mem_heap_get_size(struct mem_heap *heap, void *zone) {
+    HEAP_LOCKED_OR(heap_header(heap), MEM_GET_SIZE_ERROR);
+    struct allocator_header *h = heap_header(heap);
+#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
+    if (zone == fb_head(h)) {
+        // Special case of `mem_alloc(0)`
+        return 0;
+    }
+#endif
 
-bool is_fb_link_valid(struct fb *x) {
-    if (x->next == NULL) {
-        return true;
-    } else {
-        struct fb *y = x->next;
-        size_t dif = (size_t) ((void *) y - (void *) x) -8 ;
-        return x->size <= dif;
+    if (h->large && !heap_contains(h, zone)) {
+        struct large_block *large = large_find(h, zone);
+        return large ? large_size(large) : MEM_GET_SIZE_ERROR;
     }
-}
 
+    struct slab *slab = slab_of(h, zone);
+    if (slab) {
+        return slab_index(slab, zone) < 0 ? MEM_GET_SIZE_ERROR : slab->object_size;
+    }
 
-void mem_init(void *mem, size_t taille, bool enable_guards) {
-    // On s'assure que l'attribut ((aligned)) ci-dessus marche bien avec notre compilateur
-    // Un bon compilateur optimisera sans aucun doute la ligne ci-dessous en l'enlevant
-    assert(sizeof(struct allocator_header) % 16 == 0);
+    struct fb *cell = find_block(h, zone);
+    if (!cell) {
+        return MEM_GET_SIZE_ERROR; // On retourne la val. max d'un size_t pour signifier une erreur
+    }
+    return block_size(h, cell);
+}
 
-    // On met en place fb
-    memory_addr = mem;
-    //On met en place allocator header
-    *get_header() = (struct allocator_header) {
-        .memory_size = taille,
-        .guards_enabled = enable_guards,
-    };
-    /* On vérifie qu'on a bien enregistré les infos et qu'on
-     * sera capable de les récupérer par la suite
-     */
-    assert(mem == get_system_memory_addr());
-    assert(taille == get_system_memory_size());
 
-    VALGRIND_CREATE_MEMPOOL(mem, sizeof(struct fb), false);
+size_t mem_get_size(void *zone) {
+    return mem_heap_get_size(mem_default_heap(), zone);
+}
 
-    struct fb *head = get_fb_head();
-    head->size = taille - sizeof(struct allocator_header);
-    head->next = NULL;
+/* Taille utile d'une zone, sans aucune vérification
+ *
+ * Réservé aux tas initialisés avec MEM_BOUNDARY_TAGS et à un appelant qui sait que la zone est allouée : seul le tag de
+ * la zone est lu, et pas la chaîne, ce qui ne nécessite pas de verrou (voir le cache par thread de malloc_stub.c).
+ */
+size_t mem_heap_get_size_unchecked(struct mem_heap *heap, void *zone) {
+    HEAP_LOCKED_OR(heap_header(heap), 0);
+    struct allocator_header *h = heap_header(heap);
+    assert(h->tags_enabled);
+    if (!heap_contains(h, zone)) {
+        return large_size(large_of(zone));
+    }
+    struct slab *slab = slab_of(h, zone);
+    if (slab) {
+        return slab->object_size;
+    }
+    return ((struct tag *) (zone - block_prefix(h)))->size & ~TAG_IN_USE;
+}
 
-    mem_fit(&mem_fit_first);
+
+size_t mem_get_size_unchecked(void *zone) {
+    return mem_heap_get_size_unchecked(mem_default_heap(), zone);
 }
 
 
-void mem_init_auto(bool enable_guards) {
-    mem_init(get_memory_adr(), get_memory_size(), enable_guards);
+/* Avec mem_fit_next, agrandir une zone en fin de tas alors qu'une zone libre peut l'accueillir gaspille la mémoire
+ *
+ * Les allocations étant placées après la dernière découpe, des tableaux agrandis sur place repousseraient sans cesse la
+ * fin du tas en laissant derrière eux des trous jamais réutilisés. Les autres stratégies reprennent les trous du début
+ * du tas : on ne fait pour elles aucune recherche. La plus grande zone libre, si elle est connue, évite aussi la
+ * recherche.
+ */
+static bool tail_growth_wasteful(struct allocator_header *h, size_t size) {
+    if (heap_fit(h) != &mem_fit_next) {
+        return false;
+    }
+    if (h->counters.largest_known) {
+        return h->counters.largest_free >= size;
+    }
+    h->counters.searches++;
+    return mem_fit_next(fb_head(h), size) != NULL;
 }
 
+/* Redimensionne sur place la zone allouée qui suit le fb cell, si c'est possible
+ *
+ * La zone est suivie d'un fb dont la zone libre peut lui céder de la place, ou en récupérer : il suffit de déplacer ce
+ * fb. Pour rétrécir c'est toujours possible, pour grandir il faut que la zone libre suivante soit assez grande (ou que
+ * ce soit la dernière et que le tas puisse grandir).
+ */
+static bool resize_in_place(struct allocator_header *h, struct fb *cell, void *mem, size_t new_size) {
+    align_correctly(&new_size);
+    void *block = (void *) cell + cell->size;
+    size_t actual_size = block_span(h, new_size);
 
-void mem_show(void (*print)(void *, size_t, int)) {
-    for (struct fb *free_zone = get_fb_head(); free_zone; free_zone = free_zone->next) {
-        struct fb *next = free_zone->next;
-        print(free_zone, free_zone->size, true);
-        if (next) {
-            print(((void *) free_zone) + free_zone->size, ((void *) next) - ((void *) free_zone) - free_zone->size,
-                  false);
+    struct fb *next = fb_next(cell);
+    void *end = (void *) next + next->size;
+    if (block + actual_size + sizeof(struct fb) > end) {
+        if (fb_next(next) || tail_growth_wasteful(h, actual_size)
+            || !heap_grow(h, actual_size - ((void *) next - block))) {
+            return false;
         }
+        end = (void *) next + next->size;
     }
-}
 
+    h->counters.in_use -= block_size(h, cell);
+    h->counters.in_use += new_size;
 
-void align_correctly(size_t *val) {
-    size_t x = *val % (size_t) ALIGNMENT;
-    *val += x ? ALIGNMENT - x : 0;
+    // On lit le chaînage avant de l'écraser, la nouvelle position pouvant recouvrir l'ancienne
+    struct fb *moved = block + actual_size;
+    struct fb *after = fb_next(next);
+    index_remove(h, next);
+    fb_set_next(moved, after);
+    moved->size = end - (void *) moved;
+    fb_set_next(cell, moved);
+    fb_absorbed(h, next, moved);
+    index_insert(h, moved);
+    tag_adopt(h, moved);
+
+    if (h->tags_enabled) {
+        ((struct tag *) block)->size = new_size | TAG_IN_USE;
+    }
+    if (h->guards_enabled) {
+        ((guard *) moved)[-1] = GUARD_VALUE;
+    }
+    if ((void *) moved < (void *) next) {
+        trim_free(h, moved, moved, (void *) next + FB_METADATA_SIZE);
+    }
+    VALGRIND_MEMPOOL_CHANGE(h, mem, mem, new_size);
+    return true;
 }
 
 
-void *mem_alloc(size_t requested_size) {
-#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
-    if (requested_size == 0) {
-        // On peut retourner n'importe quel pointeur mais pour éviter les UB, il faut qu'il soit non-nul et aligné à la
-        // taille d'un registre. Ce cas sera géré dans `mem_free`.
-        return get_fb_head();
+void *mem_heap_realloc(struct mem_heap *heap, void *old, size_t new_size) {
+    HEAP_LOCKED_OR(heap_header(heap), NULL);
+    struct allocator_header *h = heap_header(heap);
+    if (!old) {
+        return mem_heap_alloc(heap, new_size);
+    }
+    if (new_size > MAX_REQUEST_SIZE) {
+        h->counters.failed++;
+        return NULL;
     }
-#endif
 
-    // On aligne, c'est plus prudent, car cela garantit que tous les fb sont alignés (le contraire serait
-    // potentiellement problématique sur certaines architectures).
-    align_correctly(&requested_size);
+    bool becomes_large = h->large_threshold && new_size >= h->large_threshold;
+    size_t old_size;
+    struct slab *slab;
+    if (h->large && !heap_contains(h, old)) {
+        struct large_block *large = large_find(h, old);
+        if (!large) {
+            return NULL;
+        }
+        if (becomes_large) {
+            void *moved = large_realloc(h, large, new_size);
+            if (moved && moved != old) {
+                profile_on_free(old);
+                profile_on_alloc(moved, new_size);
+            }
+            return moved;
+        }
+        old_size = large_size(large);
+    } else if ((slab = slab_of(h, old))) {
+        // Un objet reste dans son slab tant qu'il ne change pas de classe
+        if (slab_index(slab, old) < 0) {
+            return NULL;
+        }
+        old_size = slab->object_size;
+        size_t aligned = new_size;
+        align_correctly(&aligned);
+        if (aligned == old_size || (!aligned && old_size == ALIGNMENT)) {
+            return old;
+        }
+    } else {
+        struct fb *cell = find_block(h, old);
+        if (!cell) {
+            return NULL;
+        }
+        // Une zone qui devient grande va dans sa propre projection, pour pouvoir ensuite grandir sans copie
+        if (!becomes_large && resize_in_place(h, cell, old, new_size)) {
+            return old;
+        }
+        old_size = mem_heap_get_size(heap, old);
+    }
+
+    void *result = mem_heap_alloc(heap, new_size);
+    if (result) {
+        memcpy(result, old, old_size < new_size ? old_size : new_size);
+        mem_heap_free(heap, old);
+    }
+    return result;
+}
+
 
-    bool guards_enabled = get_header()->guards_enabled;
-    size_t actual_size = requested_size + (!guards_enabled ? 0 : 2*sizeof(guard));
+void *mem_realloc(void *old, size_t new_size) {
+    return mem_heap_realloc(mem_default_heap(), old, new_size);
+}
 
-    struct fb *fb = get_header()->fit(get_fb_head(), actual_size);
 
-    if (fb) {
-        struct fb *new_fb = ((void *) fb) + sizeof(struct fb) + actual_size;
-        new_fb->size = fb->size - actual_size - sizeof(struct fb);
-        new_fb->next = fb->next;
+/* Pools d'objets de même taille
+ *
+ * Un pool découpe ses objets dans des blocs alloués d'un seul tenant dans son tas, de plus en plus grands (jusqu'à
+ * POOL_CHUNK_MAX octets, ou plus si un seul appel à mem_pool_get_n le demande). Les objets rendus sont chaînés par
+ * leur premier mot et resservis en priorité ; les autres sont pris à la suite dans le dernier bloc. Obtenir ou rendre
+ * n objets ne coûte donc qu'une recherche dans la chaîne par nouveau bloc, au lieu d'une par objet.
+ *
+ * Les blocs ne sont rendus au tas qu'à la destruction du pool. Les statistiques du tas comptent les blocs, pas les
+ * objets.
+ *
+ * Un pool n'est pas verrouillé et chaîne ses objets par des adresses absolues : il est refusé sur un tas partagé.
+ */
 
-        fb->size = sizeof(struct fb);
-        fb->next = ((void *) fb) + sizeof(struct fb) + actual_size;
+#define POOL_CHUNK_MIN ((size_t) 4096)
+#define POOL_CHUNK_MAX ((size_t) 64 * 1024)
 
-        void* allocated = (void *) fb + sizeof(struct fb);
+struct pool_chunk {
+    struct pool_chunk *next;
+};
 
-        if (guards_enabled) {
-            *((guard*) allocated) = GUARD_VALUE;
-            allocated += sizeof(guard);
-            *((guard*) (allocated + requested_size)) = GUARD_VALUE;
-        }
+struct mem_pool {
+    struct mem_heap *heap;
+    size_t stride;          // taille d'un objet, arrondie à l'alignement
+    size_t align;
+    size_t offset;          // position du premier objet dans un bloc
+    size_t chunk_objects;   // nombre d'objets du prochain bloc
+    void *free;             // objets rendus, chaînés par leur premier mot
+    void *bump;             // objets jamais servis du dernier bloc, de bump à bump_end
+    void *bump_end;
+    struct pool_chunk *chunks;
+};
 
-        VALGRIND_MEMPOOL_ALLOC(get_system_memory_addr(), allocated, requested_size);
-        return allocated;
-    } else {
+struct mem_pool *mem_heap_pool_create(struct mem_heap *heap, size_t obj_size, size_t align) {
+    if (!align || (align & (align - 1)) || obj_size > SIZE_MAX / 2 || align > SIZE_MAX / 2) {
+        return NULL;
+    }
+    if (heap_header(heap)->shared) {
         return NULL;
     }
+    align = align < sizeof(void *) ? sizeof(void *) : align;
+    struct mem_pool *pool = mem_heap_alloc(heap, sizeof(struct mem_pool));
+    if (!pool) {
+        return NULL;
+    }
+    size_t stride = obj_size < sizeof(void *) ? sizeof(void *) : obj_size;
+    stride = (stride + align - 1) & ~(align - 1);
+    *pool = (struct mem_pool) {
+        .heap = heap,
+        .stride = stride,
+        .align = align,
+        .offset = (sizeof(struct pool_chunk) + align - 1) & ~(align - 1),
+        .chunk_objects = stride < POOL_CHUNK_MIN ? POOL_CHUNK_MIN / stride : 1,
+    };
+    return pool;
 }
 
+struct mem_pool *mem_pool_create(size_t obj_size, size_t align) {
+    return mem_heap_pool_create(mem_default_heap(), obj_size, align);
+}
 
-bool mem_free(void *mem) {
-#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
-    if (mem == get_fb_head()) {
-        // Special case of `mem_alloc(0)`
-        return true;
+// Ajoute un bloc d'au moins n objets, qui deviennent les objets à servir à la suite
+static bool pool_grow(struct mem_pool *pool, size_t n) {
+    struct allocator_header *h = heap_header(pool->heap);
+    size_t count = n > pool->chunk_objects ? n : pool->chunk_objects;
+    if (count > (SIZE_MAX - pool->offset - ALIGNMENT) / pool->stride) {
+        return false;
     }
-#endif
+    size_t size = pool->offset + count * pool->stride;
+    align_correctly(&size);
+    struct pool_chunk *chunk = account_alloc(h, heap_carve(h, size, pool->align > ALIGNMENT ? pool->align : ALIGNMENT),
+                                             size);
+    if (!chunk) {
+        return false;
+    }
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->bump = (void *) chunk + pool->offset;
+    pool->bump_end = pool->bump + count * pool->stride;
+    if (pool->chunk_objects * pool->stride < POOL_CHUNK_MAX / 2) {
+        pool->chunk_objects *= 2;
+    }
+    return true;
+}
 
-    bool guards_enabled = get_header()->guards_enabled;
-    if (guards_enabled) {
-        mem -= sizeof(guard);
+/* Place n objets dans objs, et renvoie le nombre d'objets obtenus
+ *
+ * Il est inférieur à n seulement si le tas est plein, les objets obtenus restant alors à rendre.
+ */
+size_t mem_pool_get_n(struct mem_pool *pool, void **objs, size_t n) {
+    size_t i = 0;
+    for (; i < n && pool->free; i++) {
+        objs[i] = pool->free;
+        pool->free = *(void **) pool->free;
+    }
+    if (i < n && (size_t) (pool->bump_end - pool->bump) < (n - i) * pool->stride) {
+        // Les objets restants du bloc courant sont perdus jusqu'à la destruction du pool : on les rend d'abord
+        while (pool->bump < pool->bump_end) {
+            objs[i++] = pool->bump;
+            pool->bump += pool->stride;
+        }
+        if (i < n && !pool_grow(pool, n - i)) {
+            return i;
+        }
     }
+    for (; i < n; i++) {
+        objs[i] = pool->bump;
+        pool->bump += pool->stride;
+    }
+    return n;
+}
 
-    for (struct fb *cell = get_fb_head(); cell; cell = cell->next) {
-        // détection de chaînages invalides causés par un écrasement des données de l'allocateur
-        FB_VALID_OR(cell, false);
-        if (((void *) cell) + cell->size == mem) {
-            if (guards_enabled) {
-                bool left_guard_violation = ((guard*) mem)[0] != GUARD_VALUE;
-                bool right_guard_violation = ((guard*) cell->next)[-1] != GUARD_VALUE;
-                if (left_guard_violation || right_guard_violation) {
-                    LAST_ERROR = GUARD_VIOLATION;
-                    return false;
-                }
-            }
+void *mem_pool_get(struct mem_pool *pool) {
+    void *obj;
+    return mem_pool_get_n(pool, &obj, 1) ? obj : NULL;
+}
 
-            cell->size = (size_t) ((void *) cell->next - ((void *) cell)) + cell->next->size;
-            cell->next = cell->next->next;
-            VALGRIND_MEMPOOL_FREE(get_system_memory_addr(), mem + (guards_enabled ? sizeof(guard) : 0));
-            return true;
+// Rend n objets obtenus de ce pool (NULL est ignoré). Aucune vérification n'est faite.
+void mem_pool_put_n(struct mem_pool *pool, void **objs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (objs[i]) {
+            *(void **) objs[i] = pool->free;
+            pool->free = objs[i];
         }
     }
+}
 
-    set_error_code(NOT_ALLOCATED);
-    return false; // on essaie de libérer une zone mémoire non allouée
+void mem_pool_put(struct mem_pool *pool, void *obj) {
+    mem_pool_put_n(pool, &obj, 1);
 }
 
+// Rend au tas tous les blocs du pool : ses objets, rendus ou non, ne sont plus utilisables
+void mem_pool_destroy(struct mem_pool *pool) {
+    while (pool->chunks) {
+        struct pool_chunk *chunk = pool->chunks;
+        pool->chunks = chunk->next;
+        mem_heap_free(pool->heap, chunk);
+    }
+    mem_heap_free(pool->heap, pool);
+}
 
-struct fb *mem_fit_first(struct fb *list, size_t size) {
-    for (struct fb *cell = list; cell; cell = cell->next) {
-        // détection de chaînages invalides causés par un écrasement des données de l'allocateur
-        FB_VALID_OR(cell, NULL);
-        if (!is_fb_link_valid(cell)) {
-            set_error_code(FB_LINK_BROKEN);
-            return NULL;
-        }
-        ssize_t free_space = (ssize_t) cell->size - (ssize_t) 2 * (ssize_t) sizeof(struct fb);
-        if ((ssize_t) size <= free_space) {
-            return cell;
-        }
+
+/* Arènes
+ *
+ * Une arène sert des zones qui disparaissent toutes ensemble : elle avance un pointeur dans des blocs alloués dans son
+ * tas, chaînés du plus récent au plus ancien, et n'a rien à faire pour une zone isolée. mem_arena_mark note la
+ * position courante, et mem_arena_reset y revient en rendant au tas les blocs ouverts depuis. Chaque bloc est deux fois
+ * plus grand que le précédent, jusqu'à ARENA_CHUNK_MAX octets (ou la taille d'une allocation qui ne tiendrait pas).
+ *
+ * Comme un pool, une arène est refusée sur un tas partagé.
+ */
+
+#define ARENA_CHUNK_MIN ((size_t) 4096)
+#define ARENA_CHUNK_MAX ((size_t) 1024 * 1024)
+
+struct arena_chunk {
+    struct arena_chunk *prev;
+    void *end;
+} __attribute__ ((aligned (ALIGNMENT)));
+
+struct mem_arena {
+    struct mem_heap *heap;
+    struct arena_chunk *chunk;  // bloc courant, NULL tant que rien n'a été alloué
+    void *top;                  // début de la place libre du bloc courant
+    size_t chunk_size;          // taille du prochain bloc
+};
+
+// Crée une arène dont le premier bloc fait chunk_size octets (4 Kio si nul)
+struct mem_arena *mem_heap_arena_create(struct mem_heap *heap, size_t chunk_size) {
+    if (heap_header(heap)->shared) {
+        return NULL;
     }
+    struct mem_arena *arena = mem_heap_alloc(heap, sizeof(struct mem_arena));
+    if (arena) {
+        *arena = (struct mem_arena) {
+            .heap = heap,
+            .chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_MIN,
+        };
+    }
+    return arena;
+}
 
-    return NULL;
+struct mem_arena *mem_arena_create(size_t chunk_size) {
+    return mem_heap_arena_create(mem_default_heap(), chunk_size);
 }
 
-/* Fonction à faire dans un second temps
- * - utilisée par realloc() dans malloc_stub.c
- * - nécessaire pour remplacer l'allocateur de la libc
- * - donc nécessaire pour 'make test_ls'
- * Lire malloc_stub.c pour comprendre son utilisation
- * (ou en discuter avec l'enseignant)
- */
-size_t mem_get_size(void *zone) {
-#ifdef ALLOCATEUR_ZERO_OPTIMIZATION
-    if (zone == get_fb_head()) {
-        // Special case of `mem_alloc(0)`
-        return 0;
+static inline void *arena_align(void *ptr, size_t align) {
+    return (void *) (((uintptr_t) ptr + align - 1) & ~(uintptr_t) (align - 1));
+}
+
+// Renvoie une zone de size octets alignée sur align (une puissance de deux), valable jusqu'à la remise à zéro qui la
+// précède ou à la destruction de l'arène
+void *mem_arena_alloc(struct mem_arena *arena, size_t size, size_t align) {
+    if (!align || (align & (align - 1)) || size > SIZE_MAX / 2 || align > SIZE_MAX / 2) {
+        return NULL;
+    }
+    if (arena->chunk) {
+        void *allocated = arena_align(arena->top, align);
+        if (allocated <= arena->chunk->end && size <= (size_t) (arena->chunk->end - allocated)) {
+            arena->top = allocated + size;
+            return allocated;
+        }
     }
-#endif
 
-    for (struct fb *cell = get_fb_head(); cell; cell = cell->next) {
-        // détection de chaînages invalides causés par un écrasement des données de l'allocateur
-        FB_VALID_OR(cell, MEM_GET_SIZE_ERROR);
-        if (((void *) cell) + cell->size == zone) {
-            // Ne devrait pas être nul si la mémoire est dans un état valide et que la condition ci-dessus est vérifiée
-            struct fb *next = cell->next;
+    // Le bloc est aligné sur ALIGNMENT : au-delà, l'alignement peut coûter jusqu'à align octets
+    size_t needed = sizeof(struct arena_chunk) + size + (align > ALIGNMENT ? align : 0);
+    size_t chunk_size = needed > arena->chunk_size ? needed : arena->chunk_size;
+    struct arena_chunk *chunk = mem_heap_alloc(arena->heap, chunk_size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->prev = arena->chunk;
+    chunk->end = (void *) chunk + chunk_size;
+    arena->chunk = chunk;
+    if (arena->chunk_size < ARENA_CHUNK_MAX) {
+        arena->chunk_size *= 2;
+    }
+
+    void *allocated = arena_align(chunk + 1, align);
+    arena->top = allocated + size;
+    return allocated;
+}
 
-            return ((void *) next) - ((void *) cell) - cell->size;
+// Position courante de l'arène, à laquelle mem_arena_reset peut revenir
+void *mem_arena_mark(struct mem_arena *arena) {
+    return arena->top;
+}
+
+/* Libère toutes les zones allouées depuis mark (NULL pour tout libérer)
+ *
+ * Les blocs ouverts depuis sont rendus au tas. Pour une remise à zéro complète, le plus ancien est gardé pour les
+ * allocations suivantes.
+ */
+void mem_arena_reset(struct mem_arena *arena, void *mark) {
+    struct arena_chunk *chunk = arena->chunk;
+    while (chunk) {
+        if (mark && mark > (void *) chunk && mark <= chunk->end) {
+            arena->top = mark;
+            return;
+        }
+        if (!mark && !chunk->prev) {
+            arena->top = chunk + 1;
+            return;
         }
+        arena->chunk = chunk->prev;
+        mem_heap_free(arena->heap, chunk);
+        chunk = arena->chunk;
     }
+    arena->top = NULL;
+}
 
-    set_error_code(NOT_ALLOCATED);
-    return MEM_GET_SIZE_ERROR; // On retourne la val. max d'un size_t pour signifier une erreur
+// Rend au tas tous les blocs de l'arène, et l'arène elle-même
+void mem_arena_destroy(struct mem_arena *arena) {
+    while (arena->chunk) {
+        struct arena_chunk *chunk = arena->chunk;
+        arena->chunk = chunk->prev;
+        mem_heap_free(arena->heap, chunk);
+    }
+    mem_heap_free(arena->heap, arena);
 }
 
 /* Fonctions facultatives
@@ -291,12 +2484,14 @@ size_t mem_get_size(void *zone) {
  */
 struct fb *mem_fit_best(struct fb *list, size_t size) {
     bool is_min = false;
-    size_t size_min;
+    size_t size_min = 0;
     struct fb *cell_min = NULL;
+    size_t *steps = &header_of(list)->counters.search_steps;
 
-    for (struct fb *cell = list; cell; cell = cell->next) {
+    for (struct fb *cell = list; cell; cell = fb_next(cell)) {
         // détection de chaînages invalides causés par un écrasement des données de l'allocateur
         FB_VALID_OR(cell, NULL);
+        (*steps)++;
 
         ssize_t free_space = (ssize_t) cell->size - (ssize_t) 2 * (ssize_t) sizeof(struct fb);
 
@@ -317,12 +2512,14 @@ struct fb *mem_fit_best(struct fb *list, size_t size) {
 
 struct fb *mem_fit_worst(struct fb *list, size_t size) {
     bool is_max = false;
-    size_t size_max;
+    size_t size_max = 0;
     struct fb *cell_max = NULL;
+    size_t *steps = &header_of(list)->counters.search_steps;
 
-    for (struct fb *cell = list; cell; cell = cell->next) {
+    for (struct fb *cell = list; cell; cell = fb_next(cell)) {
         // détection de chaînages invalides causés par un écrasement des données de l'allocateur
         FB_VALID_OR(cell, NULL);
+        (*steps)++;
         ssize_t free_space = (ssize_t) cell->size - (ssize_t) 2 * (ssize_t) sizeof(struct fb);
 
         if ((ssize_t) size <= free_space) {
@@ -339,3 +2536,66 @@ struct fb *mem_fit_worst(struct fb *list, size_t size) {
     }
     return cell_max;
 }
+
+/* Stratégie utilisant l'index ségrégué de l'en-tête
+ *
+ * Les zones libres sont rangées par classe de taille. On cherche d'abord une classe dont toutes les zones conviennent
+ * (une recherche dans le bitmap, en temps constant), et seulement à défaut on parcourt la classe de la taille demandée.
+ */
+struct fb *mem_fit_segregated(struct fb *list, size_t size) {
+    struct allocator_header *h = header_of(list);
+    if (h->index != INDEX_SEGREGATED) {
+        // L'index n'est construit que si la stratégie a été choisie via mem_fit
+        return mem_fit_first(list, size);
+    }
+
+    size_t c = size_class(size);
+    size_t found = class_map_find(h, class_min_size(c) == size ? c : c + 1);
+    h->counters.search_steps++;
+    if (found < NB_CLASSES) {
+        return rel_get(&h->classes[found]);
+    }
+
+    for (struct fb *cell = rel_get(&h->classes[c]); cell; cell = rel_get(&fb_links(cell)->next)) {
+        h->counters.search_steps++;
+        if (fb_free_space(cell) >= size) {
+            return cell;
+        }
+    }
+    return NULL;
+}
+
+/* Best fit et worst fit utilisant l'arbre des tailles
+ *
+ * Même choix que mem_fit_best (la plus petite zone suffisante, la première en cas d'égalité), mais en temps
+ * logarithmique. Pour mem_fit_worst_tree, la plus grande zone est connue en permanence ; en cas d'égalité c'est la
+ * dernière qui est choisie, et non la première comme dans mem_fit_worst.
+ */
+struct fb *mem_fit_best_tree(struct fb *list, size_t size) {
+    struct allocator_header *h = header_of(list);
+    if (h->index != INDEX_TREE) {
+        return mem_fit_best(list, size);
+    }
+
+    struct fb *best = NULL;
+    for (struct fb *node = rel_get(&h->tree_root); node;) {
+        h->counters.search_steps++;
+        if (fb_free_space(node) >= size) {
+            best = node;
+            node = tree_left(node);
+        } else {
+            node = tree_right(node);
+        }
+    }
+    return best;
+}
+
+struct fb *mem_fit_worst_tree(struct fb *list, size_t size) {
+    struct allocator_header *h = header_of(list);
+    if (h->index != INDEX_TREE) {
+        return mem_fit_worst(list, size);
+    }
+    h->counters.search_steps++;
+    struct fb *max = rel_get(&h->tree_max);
+    return max && fb_free_space(max) >= size ? max : NULL;
+}
@@ -9,17 +9,122 @@ extern enum error_code {
     NOT_ALLOCATED,
     FB_LINK_BROKEN,
     GUARD_VIOLATION,
+    SIZE_MISMATCH,
+    HEAP_POISONED,
 } LAST_ERROR;
 
 struct fb;
 
+/* Options de mem_init_flags */
+enum mem_flags {
+    MEM_GUARDS = 1 << 0,        // gardes autour de chaque zone allouée
+    MEM_BOUNDARY_TAGS = 1 << 1, // en-tête par zone allouée : libération et taille en temps constant
+    MEM_SLABS = 1 << 2,         // petits objets (jusqu'à 64 octets) sans en-tête, regroupés dans des slabs
+    MEM_SIZE_CHECKS = 1 << 3,   // mem_free_sized vérifie la taille donnée
+};
+
 /* fonctions principales de l'allocateur */
 void mem_init(void* mem, size_t taille, bool guards_enabled);
+void mem_init_flags(void* mem, size_t taille, unsigned flags);
+bool mem_init_mmap(size_t reserve, unsigned flags);
+bool mem_init_shared(int fd, size_t size, unsigned flags);
+bool mem_attach(void* addr);
 void mem_init_auto(bool enable_guards);
 void* mem_alloc(size_t size);
+void* mem_alloc_aligned(size_t size, size_t align);
+void* mem_calloc(size_t count, size_t size);
+size_t mem_alloc_batch(size_t size, size_t n, void **out);
 bool mem_free(void* ptr);
+bool mem_free_sized(void* ptr, size_t size);
+bool mem_free_batch(void **ptrs, size_t n);
 size_t mem_get_size(void *zone);
+size_t mem_get_size_unchecked(void *zone);
 void* mem_realloc(void *old, size_t new_size);
+size_t mem_trim(void);
+
+/* Tas indépendants
+ * Les fonctions ci-dessus travaillent sur le tas par défaut (celui de mem_init), celles-ci sur un tas quelconque créé
+ * par mem_heap_create dans la mémoire fournie. Détruire un tas libère d'un coup tout ce qu'il contient.
+ */
+struct mem_heap;
+
+struct mem_heap *mem_heap_create(void* mem, size_t taille, unsigned flags);
+struct mem_heap *mem_heap_create_mmap(size_t reserve, unsigned flags);
+struct mem_heap *mem_heap_create_shared(int fd, size_t size, unsigned flags);
+struct mem_heap *mem_heap_attach(int fd);
+void mem_heap_destroy(struct mem_heap *heap);
+struct mem_heap *mem_default_heap(void);
+size_t mem_heap_memory_size(struct mem_heap *heap);
+void* mem_heap_alloc(struct mem_heap *heap, size_t size);
+void* mem_heap_alloc_aligned(struct mem_heap *heap, size_t size, size_t align);
+void* mem_heap_calloc(struct mem_heap *heap, size_t count, size_t size);
+size_t mem_heap_alloc_batch(struct mem_heap *heap, size_t size, size_t n, void **out);
+bool mem_heap_free(struct mem_heap *heap, void *ptr);
+bool mem_heap_free_sized(struct mem_heap *heap, void *ptr, size_t size);
+bool mem_heap_free_batch(struct mem_heap *heap, void **ptrs, size_t n);
+size_t mem_heap_get_size(struct mem_heap *heap, void *zone);
+size_t mem_heap_get_size_unchecked(struct mem_heap *heap, void *zone);
+void* mem_heap_realloc(struct mem_heap *heap, void *old, size_t new_size);
+void mem_heap_large_threshold(struct mem_heap *heap, size_t threshold);
+void mem_heap_show(struct mem_heap *heap, void (*print)(void *adr, size_t size, int free));
+size_t mem_heap_trim(struct mem_heap *heap);
+void mem_heap_trim_policy(struct mem_heap *heap, size_t region_threshold, size_t high_water);
+bool mem_heap_defer_frees(struct mem_heap *heap, size_t budget);
+
+/* Pools d'objets d'une même taille, alignés sur align (une puissance de deux)
+ * Les objets sont découpés par lots dans de grands blocs du tas : les variantes _n obtiennent ou rendent n objets d'un
+ * coup. Les objets ne se libèrent pas avec mem_free mais se rendent au pool, et disparaissent avec lui.
+ */
+struct mem_pool;
+
+struct mem_pool *mem_pool_create(size_t obj_size, size_t align);
+struct mem_pool *mem_heap_pool_create(struct mem_heap *heap, size_t obj_size, size_t align);
+void mem_pool_destroy(struct mem_pool *pool);
+void *mem_pool_get(struct mem_pool *pool);
+void mem_pool_put(struct mem_pool *pool, void *obj);
+size_t mem_pool_get_n(struct mem_pool *pool, void **objs, size_t n);
+void mem_pool_put_n(struct mem_pool *pool, void **objs, size_t n);
+
+/* Arènes : allocations par simple avancée d'un pointeur, libérées toutes ensemble
+ * mem_arena_reset(arena, mark) libère tout ce qui a été alloué depuis mem_arena_mark(arena) ; avec NULL, tout ce que
+ * contient l'arène. Les zones d'une arène ne se libèrent pas avec mem_free.
+ */
+struct mem_arena;
+
+struct mem_arena *mem_arena_create(size_t chunk_size);
+struct mem_arena *mem_heap_arena_create(struct mem_heap *heap, size_t chunk_size);
+void mem_arena_destroy(struct mem_arena *arena);
+void *mem_arena_alloc(struct mem_arena *arena, size_t size, size_t align);
+void *mem_arena_mark(struct mem_arena *arena);
+void mem_arena_reset(struct mem_arena *arena, void *mark);
+
+/* Statistiques d'un tas, tenues à jour au fil des opérations : les lire ne coûte presque rien */
+struct mem_stats {
+    size_t heap_size;       // mémoire occupée par le tas, hors grandes allocations
+    size_t in_use;          // octets alloués (tailles alignées), grandes allocations comprises
+    size_t free;            // octets allouables dans les zones libres
+    size_t largest_free;    // plus grande allocation possible sans agrandir le tas
+    size_t free_zones;      // nombre de zones libres
+    double fragmentation;   // fragmentation externe : 1 - largest_free / free
+    size_t allocs;          // allocations réussies
+    size_t frees;           // libérations réussies
+    size_t failed;          // allocations échouées
+    size_t splits;          // zones libres découpées par une allocation
+    size_t merges;          // zones libérées fusionnées avec la zone libre suivante
+    double average_search;  // nombre moyen de zones examinées par allocation (stratégies fournies seulement)
+};
+
+void mem_heap_stats(struct mem_heap *heap, struct mem_stats *stats);
+void mem_stats(struct mem_stats *stats);
+
+/* Profilage du tas par échantillonnage (voir mem_profile.c)
+ * Une allocation est échantillonnée tous les sample_period octets en moyenne, avec sa pile d'appels ; le profil des
+ * échantillons encore vivants est écrit au format « folded stacks ».
+ */
+bool mem_profile_start(size_t sample_period);
+void mem_profile_stop(void);
+bool mem_profile_dump(int fd);
+bool mem_profile_dump_on_signal(int signo, const char *path);
 
 /* Itération sur le contenu de l'allocateur */
 /* nécessaire pour le mem_shell */
@@ -30,8 +135,13 @@ void mem_show(void (*print)(void *adr, size_t size, int free));
 typedef struct fb* (mem_fit_function_t)(struct fb*, size_t);
 
 void mem_fit(mem_fit_function_t*);
+void mem_heap_fit(struct mem_heap *heap, mem_fit_function_t*);
 mem_fit_function_t mem_fit_first;
+mem_fit_function_t mem_fit_next;
 mem_fit_function_t mem_fit_worst;
 mem_fit_function_t mem_fit_best;
+mem_fit_function_t mem_fit_segregated;
+mem_fit_function_t mem_fit_best_tree;
+mem_fit_function_t mem_fit_worst_tree;
 
 #endif
@@ -0,0 +1,290 @@
+#include "mem.h"
+#include "mem_profile.h"
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Profileur du tas par échantillonnage
+ *
+ * En moyenne, une allocation est échantillonnée tous les sample_period octets alloués : chaque thread décompte les
+ * octets alloués et, quand le compteur passe sous zéro, la pile d'appels de l'allocation est enregistrée et un nouvel
+ * intervalle est tiré au hasard entre 1 et 2 * sample_period. Un échantillon représente donc environ sample_period
+ * octets, ou sa propre taille si elle est plus grande.
+ *
+ * Les échantillons vivants sont gardés dans une table de hachage indexée par le pointeur renvoyé à l'utilisateur, et
+ * retirés à la libération de la zone. La table est projetée avec mmap, hors de tout tas, et n'est touchée que sous un
+ * verrou, c'est-à-dire seulement quand un échantillon est pris ou libéré.
+ *
+ * Le profil est écrit au format « folded stacks » (une ligne par échantillon : les fonctions de la plus externe à la
+ * plus interne séparées par des points-virgules, puis le nombre d'octets), que lisent flamegraph.pl, speedscope ou
+ * inferno. Les fonctions sans symbole exporté apparaissent sous forme d'adresse.
+ */
+
+#define PROFILE_SLOTS 65536 // capacité de la table, qui n'est remplie qu'aux trois quarts
+#define PROFILE_DEPTH 32
+
+struct profile_sample {
+    void *ptr; // NULL pour une case vide
+    size_t size;
+    size_t weight;
+    size_t depth;
+    void *frames[PROFILE_DEPTH];
+};
+
+bool profile_enabled;
+volatile sig_atomic_t profile_dump_requested;
+__thread ssize_t profile_countdown;
+unsigned short profile_filter[PROFILE_FILTER_SIZE];
+
+static struct profile_sample *table;
+static size_t live;
+static size_t period;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static char dump_path[4096];
+
+static __thread bool thread_started;
+static __thread uint64_t thread_random;
+
+// Intervalle avant le prochain échantillon, uniforme entre 1 et 2 * period (xorshift par thread)
+static ssize_t next_interval() {
+    if (!thread_random) {
+        thread_random = (uint64_t) (uintptr_t) &thread_random * 0x9e3779b97f4a7c15ull | 1;
+    }
+    thread_random ^= thread_random << 13;
+    thread_random ^= thread_random >> 7;
+    thread_random ^= thread_random << 17;
+    return (ssize_t) (1 + thread_random % (2 * period));
+}
+
+static inline size_t slot_of(void *ptr) {
+    return (size_t) (((uint64_t) (uintptr_t) ptr * 0x9e3779b97f4a7c15ull) >> 40) % PROFILE_SLOTS;
+}
+
+// Retire l'échantillon de la case i, en recompactant les cases suivantes (sondage linéaire sans pierres tombales)
+static void remove_slot(size_t i) {
+    profile_filter[profile_filter_index(table[i].ptr)]--;
+    live--;
+    for (size_t j = (i + 1) % PROFILE_SLOTS; table[j].ptr; j = (j + 1) % PROFILE_SLOTS) {
+        size_t home = slot_of(table[j].ptr);
+        // L'échantillon de j peut remonter en i si sa case d'origine n'est pas entre i (exclu) et j (inclus)
+        bool between = i < j ? (home > i && home <= j) : (home > i || home <= j);
+        if (!between) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i].ptr = NULL;
+}
+
+// Les deux premières adresses de la pile sont celles de record et de profile_sample, inutiles dans le profil
+#define PROFILE_SKIP 2
+
+__attribute__((noinline)) static void record(void *ptr, size_t size) {
+    void *frames[PROFILE_DEPTH + PROFILE_SKIP];
+    int depth = backtrace(frames, PROFILE_DEPTH + PROFILE_SKIP) - PROFILE_SKIP;
+
+    pthread_mutex_lock(&profile_lock);
+    if (live < PROFILE_SLOTS / 4 * 3) {
+        size_t i = slot_of(ptr);
+        while (table[i].ptr && table[i].ptr != ptr) {
+            i = (i + 1) % PROFILE_SLOTS;
+        }
+        if (!table[i].ptr) {
+            profile_filter[profile_filter_index(ptr)]++;
+            live++;
+        }
+        table[i].ptr = ptr;
+        table[i].size = size;
+        table[i].weight = size > period ? size : period;
+        table[i].depth = depth > 0 ? (size_t) depth : 0;
+        memcpy(table[i].frames, frames + PROFILE_SKIP, table[i].depth * sizeof(void *));
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+static void dump_requested() {
+    profile_dump_requested = 0;
+    int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        mem_profile_dump(fd);
+        close(fd);
+    }
+}
+
+void profile_sample(void *ptr, size_t size) {
+    if (profile_dump_requested) {
+        dump_requested();
+    }
+    if (profile_countdown >= 0) {
+        return;
+    }
+    // Un nouveau thread part d'un compteur nul : on lui tire d'abord un intervalle, pour ne pas échantillonner
+    // systématiquement sa première allocation
+    if (!thread_started) {
+        thread_started = true;
+        profile_countdown += next_interval();
+        if (profile_countdown >= 0) {
+            return;
+        }
+    }
+    profile_countdown = next_interval();
+    record(ptr, size);
+}
+
+void profile_forget(void *ptr) {
+    pthread_mutex_lock(&profile_lock);
+    if (table) {
+        for (size_t i = slot_of(ptr); table[i].ptr; i = (i + 1) % PROFILE_SLOTS) {
+            if (table[i].ptr == ptr) {
+                remove_slot(i);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+// Oublie les échantillons d'un tas détruit, dont les zones disparaissent sans être libérées
+void profile_forget_range(void *start, void *end) {
+    if (!profile_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&profile_lock);
+    for (size_t i = 0; i < PROFILE_SLOTS && live; i++) {
+        // Le recompactage peut amener en i un autre échantillon à retirer
+        while (table[i].ptr >= start && table[i].ptr < end) {
+            remove_slot(i);
+        }
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+// Gestionnaires pthread_atfork, pour que le fils d'un fork ne trouve pas le verrou pris par un autre thread
+void profile_fork_prepare() {
+    pthread_mutex_lock(&profile_lock);
+}
+
+void profile_fork_parent() {
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void profile_fork_child() {
+    pthread_mutex_init(&profile_lock, NULL);
+}
+
+/* Démarre le profilage, avec un échantillon tous les sample_period octets alloués en moyenne (0 pour l'arrêter)
+ *
+ * Tous les tas sont profilés. Renvoie faux si la table des échantillons n'a pas pu être projetée.
+ */
+bool mem_profile_start(size_t sample_period) {
+    if (!sample_period) {
+        mem_profile_stop();
+        return true;
+    }
+    // Le premier appel à backtrace peut charger libgcc et donc allouer : on le fait maintenant, hors de l'allocateur
+    void *frame;
+    backtrace(&frame, 1);
+
+    pthread_mutex_lock(&profile_lock);
+    if (!table) {
+        void *mem = mmap(NULL, PROFILE_SLOTS * sizeof(struct profile_sample), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) {
+            pthread_mutex_unlock(&profile_lock);
+            return false;
+        }
+        table = mem;
+    }
+    period = sample_period;
+    profile_enabled = true;
+    pthread_mutex_unlock(&profile_lock);
+    return true;
+}
+
+// Arrête le profilage et oublie tous les échantillons
+void mem_profile_stop() {
+    pthread_mutex_lock(&profile_lock);
+    profile_enabled = false;
+    if (table) {
+        madvise(table, PROFILE_SLOTS * sizeof(struct profile_sample), MADV_DONTNEED);
+    }
+    memset(profile_filter, 0, sizeof(profile_filter));
+    live = 0;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+static bool write_all(int fd, const char *data, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+/* Écrit le profil des échantillons vivants dans fd
+ *
+ * Rien n'est alloué (on peut être appelé depuis l'allocateur) : chaque ligne est formatée dans un tampon sur la pile.
+ */
+bool mem_profile_dump(int fd) {
+    bool ok = true;
+    pthread_mutex_lock(&profile_lock);
+    for (size_t i = 0; table && i < PROFILE_SLOTS && ok; i++) {
+        const struct profile_sample *sample = &table[i];
+        if (!sample->ptr) {
+            continue;
+        }
+        char line[4096];
+        size_t len = 0;
+        for (size_t f = sample->depth; f-- > 0 && len < sizeof(line) - 64;) {
+            Dl_info info;
+            int n;
+            if (dladdr(sample->frames[f], &info) && info.dli_sname) {
+                n = snprintf(line + len, sizeof(line) - 64 - len, "%s;", info.dli_sname);
+            } else {
+                n = snprintf(line + len, sizeof(line) - 64 - len, "%p;", sample->frames[f]);
+            }
+            len += n < 0 ? 0 : (size_t) n;
+        }
+        if (len > sizeof(line) - 64) {
+            len = sizeof(line) - 64;
+        }
+        if (len) {
+            len--; // dernier point-virgule
+        }
+        len += (size_t) snprintf(line + len, 64, " %zu\n", sample->weight);
+        ok = write_all(fd, line, len);
+    }
+    pthread_mutex_unlock(&profile_lock);
+    return ok;
+}
+
+static void on_signal(int signo) {
+    (void) signo;
+    profile_dump_requested = 1;
+}
+
+/* Écrit le profil dans le fichier path à chaque réception du signal signo
+ *
+ * Le gestionnaire ne fait que lever un drapeau : le profil est écrit par la prochaine allocation, en dehors du
+ * gestionnaire de signal.
+ */
+bool mem_profile_dump_on_signal(int signo, const char *path) {
+    if (strlen(path) >= sizeof(dump_path)) {
+        return false;
+    }
+    strcpy(dump_path, path);
+    struct sigaction action = {.sa_handler = on_signal, .sa_flags = SA_RESTART};
+    sigemptyset(&action.sa_mask);
+    return sigaction(signo, &action, NULL) == 0;
+}
@@ -0,0 +1,46 @@
+#ifndef __MEM_PROFILE_H__
+#define __MEM_PROFILE_H__
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Points d'entrée du profileur (mem_profile.c) appelés par mem.c
+ *
+ * L'interface publique (mem_profile_start, mem_profile_dump...) est dans mem.h. Ici, seules les vérifications du cas
+ * courant sont en ligne : sans échantillon, une allocation ne fait qu'une soustraction et une libération qu'une lecture
+ * dans un petit filtre.
+ */
+
+extern bool profile_enabled;
+extern volatile sig_atomic_t profile_dump_requested;
+extern __thread ssize_t profile_countdown;
+extern unsigned short profile_filter[];
+
+#define PROFILE_FILTER_SIZE 65536
+
+void profile_sample(void *ptr, size_t size);
+void profile_forget(void *ptr);
+void profile_forget_range(void *start, void *end);
+void profile_fork_prepare(void);
+void profile_fork_parent(void);
+void profile_fork_child(void);
+
+static inline size_t profile_filter_index(void *ptr) {
+    return (size_t) (((unsigned long long) (size_t) ptr * 0x9e3779b97f4a7c15ull) >> 48) % PROFILE_FILTER_SIZE;
+}
+
+static inline void profile_on_alloc(void *ptr, size_t size) {
+    if (profile_enabled && ((profile_countdown -= (ssize_t) size) < 0 || profile_dump_requested)) {
+        profile_sample(ptr, size);
+    }
+}
+
+static inline void profile_on_free(void *ptr) {
+    // Le filtre compte les échantillons vivants par case : une case nulle garantit que ptr n'est pas échantillonné
+    if (profile_enabled && profile_filter[profile_filter_index(ptr)]) {
+        profile_forget(ptr);
+    }
+}
+
+#endif
@@ -6,14 +6,16 @@
 //! l'archive ELF générée.
 //! Cette bibliothèque permet commodément de définir des variables du préprocesseur C, et fait
 //! complètement abstraction sur le compilateur utilisé en pratique, peu importe la plateforme.
+//!
+//! Le tas par défaut étant réservé avec `mmap` et agrandi à la demande, il n'y a plus besoin de
+//! définir `MEMORY_SIZE` : la zone statique de `common.c` garde sa taille par défaut.
 
 fn main() {
-    let memory_size = (1024 * 1024 * 1024).to_string();
-
     cc::Build::new()
         .file("../common.c")
         .file("../mem.c")
-        .define("MEMORY_SIZE", Some(memory_size.as_str()))
+        .file("../mem_profile.c")
+        .define("_GNU_SOURCE", None)
         .include("..")
         .compile("info3_allocateur_rs");
 }
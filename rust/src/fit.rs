@@ -5,8 +5,12 @@ extern "C" {
     pub type Fb;
 
     fn mem_fit_first(head: *const Fb, size: usize) -> *const Fb;
+    fn mem_fit_next(head: *const Fb, size: usize) -> *const Fb;
     fn mem_fit_best(head: *const Fb, size: usize) -> *const Fb;
     fn mem_fit_worst(head: *const Fb, size: usize) -> *const Fb;
+    fn mem_fit_segregated(head: *const Fb, size: usize) -> *const Fb;
+    fn mem_fit_best_tree(head: *const Fb, size: usize) -> *const Fb;
+    fn mem_fit_worst_tree(head: *const Fb, size: usize) -> *const Fb;
 }
 
 /// Fit functions provided by the C implementation
@@ -17,11 +21,27 @@ pub enum FitFunction {
     /// Finds the first free space that is big enough for the required size to fit
     First,
 
+    /// Same as [`FitFunction::First`], but resumes where the previous allocation stopped
+    /// instead of rescanning the small free spaces at the start of the heap
+    Next,
+
     /// Finds the best free space, that is the space that leaves the least amount of residue
     Best,
 
     /// Finds the worst free space, that is space that leaves the biggest residue
     Worst,
+
+    /// Looks up free spaces by size class in an index kept in the allocator header, which is
+    /// constant time for most allocations instead of a walk through the whole free list
+    Segregated,
+
+    /// Same choice as [`FitFunction::Best`], found in logarithmic time through a tree of free
+    /// spaces ordered by size
+    BestTree,
+
+    /// Same as [`FitFunction::Worst`] in constant time, through the same tree as
+    /// [`FitFunction::BestTree`]. Among equally big spaces, the last one is chosen.
+    WorstTree,
 }
 
 impl Default for FitFunction {
@@ -34,8 +54,12 @@ impl FitFunction {
     pub(crate) fn to_fn(self) -> FitFn {
         match self {
             Self::First => mem_fit_first,
+            Self::Next => mem_fit_next,
             Self::Best => mem_fit_best,
             Self::Worst => mem_fit_worst,
+            Self::Segregated => mem_fit_segregated,
+            Self::BestTree => mem_fit_best_tree,
+            Self::WorstTree => mem_fit_worst_tree,
         }
     }
 }
@@ -4,18 +4,73 @@ mod fit;
 
 use crate::fit::FitFn;
 pub use crate::fit::FitFunction;
-use std::alloc::{AllocError, Allocator, GlobalAlloc, Layout};
+use std::alloc::{self, AllocError, Allocator, GlobalAlloc, Layout};
+use std::hint;
 use std::ops::Deref;
 use std::ptr::{null_mut, NonNull};
+use std::sync::atomic::{AtomicBool, Ordering};
 
 extern "C" {
-    fn get_memory_size() -> usize;
-    fn get_memory_adr() -> *mut u8;
-    fn mem_init(memory: *mut u8, size: usize, enable_guards: bool);
+    /// Opaque `struct mem_heap` type
+    type MemHeap;
+    /// Opaque `struct mem_pool` type
+    type MemPool;
+    /// Opaque `struct mem_arena` type
+    type MemArena;
+
+    fn mem_init_mmap(reserve: usize, flags: u32) -> bool;
     fn mem_fit(f: FitFn);
 
-    fn mem_alloc(size: usize) -> *mut u8;
-    fn mem_free(ptr: *mut u8) -> bool;
+    fn mem_alloc_aligned(size: usize, align: usize) -> *mut u8;
+    fn mem_calloc(count: usize, size: usize) -> *mut u8;
+    fn mem_free_sized(ptr: *mut u8, size: usize) -> bool;
+
+    fn mem_heap_create(memory: *mut u8, size: usize, flags: u32) -> *mut MemHeap;
+    fn mem_heap_destroy(heap: *mut MemHeap);
+    fn mem_default_heap() -> *mut MemHeap;
+    fn mem_heap_memory_size(heap: *mut MemHeap) -> usize;
+    fn mem_heap_fit(heap: *mut MemHeap, f: FitFn);
+    fn mem_heap_alloc_aligned(heap: *mut MemHeap, size: usize, align: usize) -> *mut u8;
+    fn mem_heap_free_sized(heap: *mut MemHeap, ptr: *mut u8, size: usize) -> bool;
+
+    fn mem_pool_create(obj_size: usize, align: usize) -> *mut MemPool;
+    fn mem_pool_destroy(pool: *mut MemPool);
+    fn mem_pool_get(pool: *mut MemPool) -> *mut u8;
+    fn mem_pool_put(pool: *mut MemPool, obj: *mut u8);
+    fn mem_pool_get_n(pool: *mut MemPool, objs: *mut *mut u8, n: usize) -> usize;
+    fn mem_pool_put_n(pool: *mut MemPool, objs: *mut *mut u8, n: usize);
+
+    fn mem_arena_create(chunk_size: usize) -> *mut MemArena;
+    fn mem_arena_destroy(arena: *mut MemArena);
+    fn mem_arena_alloc(arena: *mut MemArena, size: usize, align: usize) -> *mut u8;
+    fn mem_arena_mark(arena: *mut MemArena) -> *mut u8;
+    fn mem_arena_reset(arena: *mut MemArena, mark: *mut u8);
+}
+
+/// Lock of the default heap
+///
+/// The C heaps are not thread-safe, while the default heap is shared by every [Info3Allocateur],
+/// [Info3Pool], [Info3Arena] and the global allocator, possibly from several threads (such as
+/// tests run in parallel). It is a spin lock, because it must not allocate.
+static DEFAULT_HEAP_LOCK: AtomicBool = AtomicBool::new(false);
+
+/// Holds [DEFAULT_HEAP_LOCK] until dropped, even if the call in between panics
+struct DefaultHeapGuard;
+
+fn lock_default_heap() -> DefaultHeapGuard {
+    while DEFAULT_HEAP_LOCK
+        .compare_exchange_weak(false, true, Ordering::Acquire, Ordering::Relaxed)
+        .is_err()
+    {
+        hint::spin_loop();
+    }
+    DefaultHeapGuard
+}
+
+impl Drop for DefaultHeapGuard {
+    fn drop(&mut self) {
+        DEFAULT_HEAP_LOCK.store(false, Ordering::Release);
+    }
 }
 
 /// Non-global allocator
@@ -28,9 +83,8 @@ pub struct Info3Allocateur([(); 0]);
 
 lazy_static::lazy_static! {
     static ref INSTANCE: Info3Allocateur = {
-        unsafe {
-            mem_init(get_memory_adr(), get_memory_size(), false);
-        }
+        // The default heap grows on demand, within a large address space reservation
+        assert!(unsafe { mem_init_mmap(0, 0) }, "cannot reserve memory for the heap");
 
         Info3Allocateur([])
     };
@@ -43,14 +97,17 @@ impl Default for Info3Allocateur {
 }
 
 impl Info3Allocateur {
+    /// Current size of the default heap, which grows as needed
     pub fn size(self) -> usize {
-        unsafe { get_memory_size() }
+        let _guard = lock_default_heap();
+        unsafe { mem_heap_memory_size(mem_default_heap()) }
     }
 
     /// Use an alternative fit function
     ///
     /// By default, allocators use the [`FitFunction::First`] strategy
     pub fn set_fit_function(self, fit: FitFunction) {
+        let _guard = lock_default_heap();
         unsafe {
             mem_fit(fit.to_fn());
         }
@@ -60,20 +117,272 @@ impl Info3Allocateur {
 unsafe impl Allocator for Info3Allocateur {
     fn allocate(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
         let (size, align) = (layout.size(), layout.align());
-        assert!(align <= 16);
 
-        let ptr = unsafe { mem_alloc(size) };
-        assert_eq!(ptr as usize % 16, 0);
+        // Every allocation is aligned on 16 bytes, larger alignments are carved on purpose
+        let ptr = {
+            let _guard = lock_default_heap();
+            unsafe { mem_alloc_aligned(size, align) }
+        };
+        assert_eq!(ptr as usize % align, 0);
+        NonNull::new(ptr)
+            .map(|non_null| NonNull::from_raw_parts(non_null.cast(), size))
+            .ok_or(AllocError)
+    }
+
+    fn allocate_zeroed(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        let (size, align) = (layout.size(), layout.align());
+
+        // mem_calloc only clears the part of the zone that was used before
+        let _guard = lock_default_heap();
+        let ptr = unsafe {
+            if align <= 16 {
+                mem_calloc(1, size)
+            } else {
+                let ptr = mem_alloc_aligned(size, align);
+                if !ptr.is_null() {
+                    ptr.write_bytes(0, size);
+                }
+                ptr
+            }
+        };
+        NonNull::new(ptr)
+            .map(|non_null| NonNull::from_raw_parts(non_null.cast(), size))
+            .ok_or(AllocError)
+    }
+
+    // The layout spares the allocator the search for the zone
+    unsafe fn deallocate(&self, ptr: NonNull<u8>, layout: Layout) {
+        let _guard = lock_default_heap();
+        assert!(
+            mem_free_sized(ptr.as_ptr(), layout.size()),
+            "error while deallocating"
+        );
+    }
+}
+
+/// Independent allocator, managing its own memory
+///
+/// Unlike [Info3Allocateur], which always uses the single default heap, each instance is a separate
+/// C heap (`mem_heap_create`) in a buffer owned by the instance. Allocations from different
+/// instances never interfere, and dropping the instance releases everything it contains at once.
+/// Use it through a reference, such as `Vec::new_in(&heap)`.
+pub struct Info3Heap {
+    heap: NonNull<MemHeap>,
+    memory: NonNull<u8>,
+    layout: Layout,
+}
+
+impl Info3Heap {
+    /// Creates a heap of `size` bytes, header included
+    ///
+    /// Returns `None` if `size` is too small to hold the heap header and a first free zone.
+    pub fn new(size: usize) -> Option<Self> {
+        let layout = Layout::from_size_align(size, 16).ok()?;
+        if layout.size() == 0 {
+            return None;
+        }
+        let memory = NonNull::new(unsafe { alloc::alloc(layout) })
+            .unwrap_or_else(|| alloc::handle_alloc_error(layout));
+        match NonNull::new(unsafe { mem_heap_create(memory.as_ptr(), size, 0) }) {
+            Some(heap) => Some(Info3Heap {
+                heap,
+                memory,
+                layout,
+            }),
+            None => {
+                unsafe { alloc::dealloc(memory.as_ptr(), layout) };
+                None
+            }
+        }
+    }
+
+    pub fn size(&self) -> usize {
+        self.layout.size()
+    }
+
+    /// Use an alternative fit function for this heap only
+    pub fn set_fit_function(&self, fit: FitFunction) {
+        unsafe {
+            mem_heap_fit(self.heap.as_ptr(), fit.to_fn());
+        }
+    }
+}
+
+impl Drop for Info3Heap {
+    fn drop(&mut self) {
+        unsafe {
+            mem_heap_destroy(self.heap.as_ptr());
+            alloc::dealloc(self.memory.as_ptr(), self.layout);
+        }
+    }
+}
+
+unsafe impl Allocator for Info3Heap {
+    fn allocate(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        let (size, align) = (layout.size(), layout.align());
+
+        let ptr = unsafe { mem_heap_alloc_aligned(self.heap.as_ptr(), size, align) };
+        NonNull::new(ptr)
+            .map(|non_null| NonNull::from_raw_parts(non_null.cast(), size))
+            .ok_or(AllocError)
+    }
+
+    unsafe fn deallocate(&self, ptr: NonNull<u8>, layout: Layout) {
+        assert!(
+            mem_heap_free_sized(self.heap.as_ptr(), ptr.as_ptr(), layout.size()),
+            "error while deallocating"
+        );
+    }
+}
+
+/// Pool of identical objects, carved in batches from the default heap (`mem_pool_create`)
+///
+/// It serves any layout that fits in the layout given at creation, typically through
+/// `Box::new_in(value, &pool)`. Objects are taken from large blocks, so that allocating many of
+/// them costs a single search in the heap; [`Info3Pool::allocate_batch`] gets many at once.
+/// Dropping the pool releases all its blocks.
+pub struct Info3Pool {
+    pool: NonNull<MemPool>,
+    layout: Layout,
+}
+
+impl Info3Pool {
+    pub fn new(layout: Layout) -> Self {
+        lazy_static::initialize(&INSTANCE);
+        let pool = {
+            let _guard = lock_default_heap();
+            unsafe { mem_pool_create(layout.size(), layout.align()) }
+        };
+        Info3Pool {
+            pool: NonNull::new(pool).unwrap_or_else(|| alloc::handle_alloc_error(layout)),
+            layout,
+        }
+    }
+
+    /// Pool for values of type `T`
+    pub fn of<T>() -> Self {
+        Self::new(Layout::new::<T>())
+    }
+
+    /// Fills `objs` with objects of the pool, and returns how many could be allocated
+    pub fn allocate_batch(&self, objs: &mut [*mut u8]) -> usize {
+        let _guard = lock_default_heap();
+        unsafe { mem_pool_get_n(self.pool.as_ptr(), objs.as_mut_ptr(), objs.len()) }
+    }
+
+    /// Gives back objects obtained from this pool (null pointers are ignored)
+    ///
+    /// # Safety
+    ///
+    /// Each object must come from this pool and must not be used afterwards.
+    pub unsafe fn deallocate_batch(&self, objs: &mut [*mut u8]) {
+        let _guard = lock_default_heap();
+        mem_pool_put_n(self.pool.as_ptr(), objs.as_mut_ptr(), objs.len());
+    }
+}
+
+impl Drop for Info3Pool {
+    fn drop(&mut self) {
+        let _guard = lock_default_heap();
+        unsafe { mem_pool_destroy(self.pool.as_ptr()) }
+    }
+}
+
+unsafe impl Allocator for Info3Pool {
+    fn allocate(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        let (size, align) = (layout.size(), layout.align());
+        if size > self.layout.size() || align > self.layout.align() {
+            return Err(AllocError);
+        }
+
+        let ptr = {
+            let _guard = lock_default_heap();
+            unsafe { mem_pool_get(self.pool.as_ptr()) }
+        };
         NonNull::new(ptr)
             .map(|non_null| NonNull::from_raw_parts(non_null.cast(), size))
             .ok_or(AllocError)
     }
 
     unsafe fn deallocate(&self, ptr: NonNull<u8>, _layout: Layout) {
-        assert!(mem_free(ptr.as_ptr()), "error while deallocating");
+        let _guard = lock_default_heap();
+        mem_pool_put(self.pool.as_ptr(), ptr.as_ptr());
     }
 }
 
+/// Arena in the default heap (`mem_arena_create`): allocating only moves a pointer forward, and
+/// deallocating does nothing
+///
+/// Memory comes back all at once, with [`Info3Arena::reset`] or when the arena is dropped. Both
+/// need the arena mutably, so that no collection allocated in it (`Vec::new_in(&arena)`) can
+/// outlive them.
+pub struct Info3Arena {
+    arena: NonNull<MemArena>,
+}
+
+/// Position in an [Info3Arena], see [`Info3Arena::reset_to`]
+#[derive(Clone, Copy, Debug)]
+pub struct Info3ArenaMark(*mut u8);
+
+impl Info3Arena {
+    /// Creates an arena whose first block is `chunk_size` bytes (or a default size if 0)
+    pub fn new(chunk_size: usize) -> Self {
+        lazy_static::initialize(&INSTANCE);
+        let arena = {
+            let _guard = lock_default_heap();
+            unsafe { mem_arena_create(chunk_size) }
+        };
+        Info3Arena {
+            arena: NonNull::new(arena).expect("cannot create the arena"),
+        }
+    }
+
+    pub fn mark(&self) -> Info3ArenaMark {
+        Info3ArenaMark(unsafe { mem_arena_mark(self.arena.as_ptr()) })
+    }
+
+    /// Frees everything allocated since `mark`
+    pub fn reset_to(&mut self, mark: Info3ArenaMark) {
+        let _guard = lock_default_heap();
+        unsafe { mem_arena_reset(self.arena.as_ptr(), mark.0) }
+    }
+
+    /// Frees everything in the arena, keeping its first block for later allocations
+    pub fn reset(&mut self) {
+        let _guard = lock_default_heap();
+        unsafe { mem_arena_reset(self.arena.as_ptr(), null_mut()) }
+    }
+}
+
+impl Default for Info3Arena {
+    fn default() -> Self {
+        Self::new(0)
+    }
+}
+
+impl Drop for Info3Arena {
+    fn drop(&mut self) {
+        let _guard = lock_default_heap();
+        unsafe { mem_arena_destroy(self.arena.as_ptr()) }
+    }
+}
+
+unsafe impl Allocator for Info3Arena {
+    fn allocate(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        let (size, align) = (layout.size(), layout.align());
+
+        let ptr = {
+            let _guard = lock_default_heap();
+            unsafe { mem_arena_alloc(self.arena.as_ptr(), size, align) }
+        };
+        NonNull::new(ptr)
+            .map(|non_null| NonNull::from_raw_parts(non_null.cast(), size))
+            .ok_or(AllocError)
+    }
+
+    unsafe fn deallocate(&self, _ptr: NonNull<u8>, _layout: Layout) {}
+}
+
 /// Global allocator, can be used with
 /// [`#[global_allocator]`][std::alloc#the-global_allocator-attribute]
 pub struct Info3AllocateurGlobal;
@@ -86,6 +395,13 @@ unsafe impl GlobalAlloc for Info3AllocateurGlobal {
             .unwrap_or(null_mut())
     }
 
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        INSTANCE
+            .allocate_zeroed(layout)
+            .map(|non_null| non_null.as_ptr().cast())
+            .unwrap_or(null_mut())
+    }
+
     unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
         if let Some(ptr) = NonNull::new(ptr) {
             INSTANCE.deallocate(ptr, layout);
@@ -19,3 +19,12 @@ fn alloc_global_vec() {
     let vec = (1..=42).collect::<Vec<_>>();
     assert_eq!(vec.last(), Some(&42));
 }
+
+#[test]
+fn alloc_global_zeroed() {
+    for _ in 0..4 {
+        let mut zeroes = vec![0u64; 100_000];
+        assert!(zeroes.iter().all(|&x| x == 0));
+        zeroes.fill(u64::MAX);
+    }
+}
@@ -1,12 +1,10 @@
-//! Tests where the allocator is used in specific locations, instead of globally. Due to the way it
-//! is implemented in C, 2 allocators cannot coexist as all "instances" actually use the same
-//! backing memory. If our C init/allocating/freeing functions took a pointer to a byte array as
-//! their first parameter, it would very much be possible to have multiple _different_ allocators
-//! at the same time.
+//! Tests where the allocator is used in specific locations, instead of globally. All
+//! [Info3Allocateur] "instances" use the same default heap, while each [Info3Heap] has its own
+//! backing memory, so that several _different_ allocators can coexist.
 
 #![feature(allocator_api)]
 
-use info3_allocateur::Info3Allocateur;
+use info3_allocateur::{FitFunction, Info3Allocateur, Info3Arena, Info3Heap, Info3Pool};
 
 #[test]
 fn alloc_vec() {
@@ -26,3 +24,78 @@ fn alloc_box() {
     *boxed_number += 2;
     assert_eq!(*boxed_number, 42);
 }
+
+#[test]
+fn independent_heaps() {
+    assert!(Info3Heap::new(0).is_none());
+    assert!(Info3Heap::new(64).is_none());
+    let first = Info3Heap::new(4096).unwrap();
+    let second = Info3Heap::new(4096).unwrap();
+    second.set_fit_function(FitFunction::Segregated);
+
+    let mut a = Vec::new_in(&first);
+    let mut b = Vec::new_in(&second);
+    a.extend(0..32u32);
+    b.extend(0..32u32);
+    assert_eq!(a, b);
+
+    let range = first.size();
+    let offset = (b.as_ptr() as usize).wrapping_sub(a.as_ptr() as usize);
+    assert!(offset >= range && offset.wrapping_neg() >= range);
+}
+
+#[test]
+fn pool() {
+    #[repr(align(64))]
+    struct Node([u64; 5]);
+
+    let pool = Info3Pool::of::<Node>();
+    let nodes: Vec<_> = (0..300).map(|i| Box::new_in(Node([i; 5]), &pool)).collect();
+    for (i, node) in nodes.iter().enumerate() {
+        assert_eq!(node.0[4], i as u64);
+        assert_eq!(&**node as *const Node as usize % 64, 0);
+    }
+    assert!(Box::try_new_in([0u64; 9], &pool).is_err());
+    drop(nodes);
+
+    let mut batch = [std::ptr::null_mut(); 500];
+    assert_eq!(pool.allocate_batch(&mut batch), 500);
+    assert!(batch.iter().all(|ptr| *ptr as usize % 64 == 0));
+    unsafe { pool.deallocate_batch(&mut batch) };
+}
+
+#[test]
+fn arena() {
+    let mut arena = Info3Arena::default();
+    let mark = arena.mark();
+    for round in 0..3u64 {
+        let mut list = Vec::new_in(&arena);
+        list.extend(0..10_000u64);
+        let aligned = Box::new_in([round; 8], &arena);
+        assert_eq!(list.iter().sum::<u64>(), 49_995_000);
+        assert_eq!(aligned[7], round);
+        drop((list, aligned));
+        arena.reset_to(mark);
+    }
+    arena.reset();
+}
+
+#[test]
+fn aligned() {
+    #[repr(align(4096))]
+    struct Page([u8; 4096]);
+    #[repr(align(64))]
+    struct Line(u64);
+
+    let heap = Info3Heap::new(65536).unwrap();
+    let page = Box::new_in(Page([7; 4096]), &heap);
+    let lines: Vec<_> = (0..16)
+        .map(|i| Box::new_in(Line(i), Info3Allocateur::default()))
+        .collect();
+    assert_eq!(&*page as *const Page as usize % 4096, 0);
+    assert_eq!(page.0[4095], 7);
+    for (i, line) in lines.iter().enumerate() {
+        assert_eq!(&**line as *const Line as usize % 64, 0);
+        assert_eq!(line.0, i as u64);
+    }
+}
@@ -1,6 +1,11 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "../mem.h"
 
 #define TEST(function) { void function(); test_function(function, #function); }
@@ -11,6 +16,7 @@ char* RESULT_OK = "\033[0;32m✓\033[0m";
 char* RESULT_ERR = "\033[0;31m✗\033[0m";
 
 void* get_memory_adr();
+size_t get_memory_size();
 
 void test_function(void (*function)(), const char* name) {
     fprintf(stderr, "%s %s\n", RESULT_ERR, name);
@@ -34,8 +40,34 @@ int main() {
     TEST(guard_violation_left);
 
     TEST(fit_first);
+    TEST(fit_next);
     TEST(fit_best);
     TEST(fit_worst);
+    TEST(fit_segregated);
+    TEST(fit_best_tree);
+    TEST(fit_worst_tree);
+    TEST(fit_tree_same_as_list);
+
+    TEST(boundary_tags);
+    TEST(boundary_tags_errors);
+
+    TEST(independent_heaps);
+    TEST(growable_heap);
+    TEST(trim);
+    TEST(large_allocations);
+    TEST(realloc_in_place);
+    TEST(slabs);
+    TEST(pools);
+    TEST(arenas);
+    TEST(aligned_allocations);
+    TEST(calloc_zeroes);
+    TEST(deferred_frees);
+    TEST(sized_frees);
+    TEST(batches);
+    TEST(shared_heap);
+
+    TEST(stats);
+    TEST(profile);
 }
 
 void comme_le_schema() {
@@ -43,8 +75,10 @@ void comme_le_schema() {
     void* b = mem_alloc(32);
     mem_free(a);
 
-    void* premier_fb = get_memory_adr() + 16;
-    assert_eq(b - premier_fb, 48 + 16); // Après le commit 9567e11, allocator_header fait 16 octets de plus qu'avant
+    // allocator_header contient maintenant l'index ségrégué, dont la taille dépend de la plateforme : on se repère donc
+    // par rapport au fb qui précède a plutôt que par rapport au début du tas
+    void* premier_fb = a - 16;
+    assert_eq(b - premier_fb, 48);
 }
 
 void alloc_free_alloc_free_same_pointer() {
@@ -152,6 +186,37 @@ void fit_first() {
     assert_eq(a_bis, a);
 }
 
+void fit_next() {
+    mem_fit(mem_fit_next);
+
+    void* a = mem_alloc(16);
+    UNUSED void* b = mem_alloc(16);
+    void* c = mem_alloc(16);
+    mem_free(a);
+
+    // Le trou laissé par a est avant le point de reprise : la recherche continue après c
+    void* d = mem_alloc(16);
+    assert(d > c);
+
+    // Arrivée au bout de la chaîne, elle reprend au début
+    static char memory[16384] __attribute__((aligned(16)));
+    struct mem_heap* heap = mem_heap_create(memory, sizeof(memory), 0);
+    mem_heap_fit(heap, mem_fit_next);
+    void* x = mem_heap_alloc(heap, 64);
+    UNUSED void* y = mem_heap_alloc(heap, 64);
+    mem_heap_free(heap, x);
+    void* last;
+    do {
+        last = mem_heap_alloc(heap, 64);
+        assert(last);
+    } while (last != x);
+
+    // Le point de reprise suit les fusions
+    mem_heap_free(heap, y);
+    mem_heap_free(heap, x);
+    assert(mem_heap_alloc(heap, 128) == x);
+}
+
 void fit_best() {
     mem_fit(mem_fit_best);
 
@@ -186,3 +251,1053 @@ void fit_worst() {
     void* c_bis = mem_alloc(32);
     assert_eq(c_bis, c);
 }
+
+void fit_segregated() {
+    mem_fit(mem_fit_segregated);
+
+    void* a = mem_alloc(320);
+    UNUSED void* b = mem_alloc(16);
+    void* c = mem_alloc(16);
+    UNUSED void* d = mem_alloc(16);
+    void* e = mem_alloc(64);
+    UNUSED void* f = mem_alloc(16);
+
+    mem_free(a);
+    mem_free(c);
+    mem_free(e);
+
+    // Les petits trous sont chacun dans leur classe : une demande de 16 octets doit prendre celui de c, une de 64
+    // celui de e, sans toucher au grand trou de a
+    void* c_bis = mem_alloc(16);
+    assert_eq(c_bis, c);
+    void* e_bis = mem_alloc(64);
+    assert_eq(e_bis, e);
+    void* a_bis = mem_alloc(200);
+    assert_eq(a_bis, a);
+
+    // L'index doit rester cohérent avec la chaîne après un changement de stratégie
+    mem_free(a_bis);
+    mem_fit(mem_fit_first);
+    assert_eq(mem_alloc(16), a);
+}
+
+void boundary_tags() {
+    mem_init_flags(get_memory_adr(), get_memory_size(), MEM_BOUNDARY_TAGS | MEM_GUARDS);
+
+    void* a = mem_alloc(16);
+    void* b = mem_alloc(40);
+    void* c = mem_alloc(16);
+    assert_eq(mem_get_size(b), 48);
+
+    // On libère dans le désordre pour que le fb précédant c change (fusion de a et b)
+    assert(mem_free(a));
+    assert(mem_free(b));
+    assert_eq(mem_get_size(c), 16);
+    assert(mem_free(c));
+
+    // Tout a fusionné : la première allocation reprend la place de a
+    assert_eq(mem_alloc(16), a);
+}
+
+void boundary_tags_errors() {
+    mem_init_flags(get_memory_adr(), get_memory_size(), MEM_BOUNDARY_TAGS);
+
+    void* a = mem_alloc(16);
+    void* b = mem_alloc(32);
+
+    assert(mem_free(a));
+    assert(!mem_free(a));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+
+    assert(!mem_free(NULL));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert(!mem_free(b + 16));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert(!mem_free((void*) -1));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert_eq(mem_get_size(a), MEM_GET_SIZE_ERROR);
+
+    assert(mem_free(b));
+}
+
+void independent_heaps() {
+    static char memory_a[4096] __attribute__((aligned(16)));
+    static char memory_b[4096] __attribute__((aligned(16)));
+    // Mémoire trop petite pour l'en-tête et une zone libre, ou mal alignée
+    assert(!mem_heap_create(memory_a, 64, 0));
+    assert(!mem_heap_create(memory_a + 8, sizeof(memory_a) - 8, 0));
+    assert(!mem_heap_create(NULL, 4096, 0));
+    struct mem_heap* heap_a = mem_heap_create(memory_a, sizeof(memory_a), 0);
+    struct mem_heap* heap_b = mem_heap_create(memory_b, sizeof(memory_b), MEM_BOUNDARY_TAGS);
+    mem_heap_fit(heap_b, mem_fit_segregated);
+
+    void* a = mem_heap_alloc(heap_a, 64);
+    void* b = mem_heap_alloc(heap_b, 64);
+    void* d = mem_alloc(64);
+    assert(a > (void*) memory_a && a < (void*) memory_a + sizeof(memory_a));
+    assert(b > (void*) memory_b && b < (void*) memory_b + sizeof(memory_b));
+    assert_eq(mem_heap_get_size(heap_b, b), 64);
+
+    // Chaque tas ne connaît que ses propres zones
+    assert(!mem_heap_free(heap_a, b));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert(!mem_free(a));
+    assert(mem_heap_free(heap_a, a));
+    assert(mem_heap_free(heap_b, b));
+    assert(mem_free(d));
+
+    // Destruction sans rien libérer : la mémoire peut accueillir un nouveau tas
+    mem_heap_alloc(heap_a, 128);
+    mem_heap_destroy(heap_a);
+    heap_a = mem_heap_create(memory_a, sizeof(memory_a), 0);
+    assert_eq(mem_heap_alloc(heap_a, 64), a);
+    mem_heap_destroy(heap_a);
+    mem_heap_destroy(heap_b);
+}
+
+void growable_heap() {
+    struct mem_heap* heap = mem_heap_create_mmap(1 << 20, 0);
+    assert(heap);
+    // Tout doit passer par le tas, même les grandes allocations
+    mem_heap_large_threshold(heap, 0);
+    size_t initial_size = mem_heap_memory_size(heap);
+
+    // Bien plus que la taille initiale : le tas doit grandir
+    void* zones[64];
+    for (int i = 0; i < 64; i++) {
+        zones[i] = mem_heap_alloc(heap, 8192);
+        assert(zones[i]);
+        memset(zones[i], i, 8192);
+    }
+    assert(mem_heap_memory_size(heap) > initial_size);
+    assert(mem_heap_memory_size(heap) <= 1 << 20);
+
+    // Mais pas au-delà de la réservation
+    assert_eq(mem_heap_alloc(heap, 1 << 20), NULL);
+
+    for (int i = 0; i < 32; i++) {
+        assert_eq(((char*) zones[i])[8191], i);
+        assert(mem_heap_free(heap, zones[i]));
+    }
+    // Avec next fit, agrandir la dernière zone au-delà de la fin du tas la déplace dans le trou du début plutôt que de
+    // faire grandir le tas
+    mem_heap_fit(heap, mem_fit_next);
+    size_t grown_size = mem_heap_memory_size(heap);
+    void* moved = mem_heap_realloc(heap, zones[63], 160 << 10);
+    assert(moved && moved < zones[32]);
+    assert_eq(((char*) moved)[8191], 63);
+    assert_eq(mem_heap_memory_size(heap), grown_size);
+    zones[63] = moved;
+
+    for (int i = 32; i < 64; i++) {
+        assert_eq(((char*) zones[i])[8191], i);
+        assert(mem_heap_free(heap, zones[i]));
+    }
+    mem_heap_destroy(heap);
+}
+
+// Nombre de pages de [adr, adr + size[ présentes en mémoire
+static size_t resident_pages(void* adr, size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    unsigned char vec[size / page];
+    assert(mincore(adr, size, vec) == 0);
+    size_t resident = 0;
+    for (size_t i = 0; i < size / page; i++) {
+        resident += vec[i] & 1;
+    }
+    return resident;
+}
+
+void trim() {
+    size_t page = sysconf(_SC_PAGESIZE);
+    struct mem_heap* heap = mem_heap_create_mmap(16 << 20, 0);
+    mem_heap_large_threshold(heap, 0);
+
+    // Libérer une grande zone rend immédiatement ses pages (politique par défaut d'un tas extensible)
+    UNUSED void* before = mem_heap_alloc(heap, 16);
+    void* big = mem_heap_alloc(heap, 1 << 20);
+    UNUSED void* after = mem_heap_alloc(heap, 16);
+    void* big_page = (void*) (((size_t) big + page - 1) & ~(page - 1));
+    memset(big, 1, 1 << 20);
+    assert_eq(resident_pages(big_page, 64 * page), 64);
+    assert(mem_heap_free(heap, big));
+    assert_eq(resident_pages(big_page, 64 * page), 0);
+
+    // Sans restitution automatique, il faut appeler mem_heap_trim
+    mem_heap_trim_policy(heap, 0, 0);
+    big = mem_heap_alloc(heap, 1 << 20);
+    memset(big, 1, 1 << 20);
+    assert(mem_heap_free(heap, big));
+    assert_eq(resident_pages(big_page, 64 * page), 64);
+    assert(mem_heap_trim(heap) >= 64 * page);
+    assert_eq(resident_pages(big_page, 64 * page), 0);
+
+    // Ou bien régler un seuil de mémoire libérée
+    mem_heap_trim_policy(heap, 0, 1 << 20);
+    big = mem_heap_alloc(heap, 1 << 20);
+    memset(big, 1, 1 << 20);
+    assert(mem_heap_free(heap, big));
+    assert_eq(resident_pages(big_page, 64 * page), 0);
+
+    // La mémoire rendue reste utilisable
+    void* again = mem_heap_alloc(heap, 1 << 20);
+    assert_eq(again, big);
+    assert_eq(((char*) again)[page * 10], 0);
+
+    mem_heap_trim_policy(heap, 128 << 10, 0);
+    // Une zone qui n'atteint le seuil qu'en fusionnant avec sa voisine : les pages de la voisine sont rendues aussi
+    void* half_a = mem_heap_alloc(heap, 96 << 10);
+    void* half_b = mem_heap_alloc(heap, 96 << 10);
+    UNUSED void* last = mem_heap_alloc(heap, 16);
+    void* half_page = (void*) (((size_t) half_a + page - 1) & ~(page - 1));
+    memset(half_a, 1, 96 << 10);
+    memset(half_b, 1, 96 << 10);
+    assert(mem_heap_free(heap, half_a));
+    assert_eq(resident_pages(half_page, 16 * page), 16);
+    assert(mem_heap_free(heap, half_b));
+    assert_eq(resident_pages(half_page, 16 * page), 0);
+    mem_heap_destroy(heap);
+}
+
+void large_allocations() {
+    struct mem_heap* heap = mem_heap_create_mmap(1 << 20, MEM_BOUNDARY_TAGS);
+    mem_heap_large_threshold(heap, 64 << 10);
+
+    // Les grandes allocations sont hors du tas, et peuvent dépasser sa réservation
+    void* small = mem_heap_alloc(heap, 1024);
+    void* large = mem_heap_alloc(heap, 4 << 20);
+    assert(large);
+    assert((size_t) large - (size_t) heap >= 1 << 20);
+    assert(mem_heap_get_size(heap, large) >= 4 << 20);
+    assert(mem_heap_get_size_unchecked(heap, large) >= 4 << 20);
+    memset(large, 42, 4 << 20);
+    // Une taille démesurée échoue, sans déborder en arrondissant à la page
+    assert(!mem_heap_alloc(heap, SIZE_MAX - 20));
+    assert(!mem_heap_alloc(heap, PTRDIFF_MAX));
+    assert(!mem_heap_realloc(heap, large, SIZE_MAX - 20));
+    assert(mem_heap_get_size(heap, large) >= 4 << 20);
+
+    // mremap conserve le contenu
+    large = mem_heap_realloc(heap, large, 32 << 20);
+    assert(large);
+    assert_eq(((char*) large)[(4 << 20) - 1], 42);
+
+    // Revenir sous le seuil ramène la zone dans le tas
+    void* large_b = mem_heap_alloc(heap, 128 << 10);
+    void* back = mem_heap_realloc(heap, large_b, 100);
+    assert((size_t) back - (size_t) heap < 1 << 20);
+
+    assert(mem_heap_free(heap, large));
+    assert(!mem_heap_free(heap, large));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert(!mem_heap_free(heap, (char*) back + (8 << 20)));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert(mem_heap_free(heap, small));
+    assert(mem_heap_free(heap, back));
+
+    // La destruction rend aussi les grandes allocations restantes
+    mem_heap_alloc(heap, 1 << 20);
+    mem_heap_destroy(heap);
+}
+
+void realloc_in_place() {
+    mem_init_flags(get_memory_adr(), get_memory_size(), MEM_GUARDS | MEM_BOUNDARY_TAGS);
+
+    void* a = mem_alloc(32);
+    void* b = mem_alloc(32);
+    memset(a, 'a', 32);
+    memset(b, 'b', 32);
+
+    // Rétrécissement : la place rendue rejoint la zone libre suivante
+    assert_eq(mem_realloc(b, 16), b);
+    assert_eq(mem_get_size(b), 16);
+    // Agrandissement dans la zone libre qui suit b
+    assert_eq(mem_realloc(b, 1000), b);
+    assert_eq(mem_get_size(b), 1008);
+    assert_eq(((char*) b)[15], 'b');
+
+    // a est suivi d'une zone occupée : il faut déplacer et recopier
+    void* a_bis = mem_realloc(a, 64);
+    assert(a_bis != a);
+    assert_eq(((char*) a_bis)[31], 'a');
+
+    // Une taille démesurée échoue sans toucher à la zone
+    assert(!mem_realloc(b, SIZE_MAX));
+    assert(!mem_realloc(b, SIZE_MAX - 8));
+    assert_eq(mem_get_size(b), 1008);
+
+    // Les gardes ont suivi les déplacements
+    assert(mem_free(b));
+    assert(mem_free(a_bis));
+    assert(!mem_free(a));
+}
+
+void fit_best_tree() {
+    mem_fit(mem_fit_best_tree);
+
+    void* a = mem_alloc(32);
+    UNUSED void* b = mem_alloc(16);
+    void* c = mem_alloc(16);
+    UNUSED void* d = mem_alloc(16);
+
+    mem_free(a);
+    mem_free(c);
+
+    void* c_bis = mem_alloc(16);
+    assert_eq(c_bis, c);
+}
+
+void fit_worst_tree() {
+    mem_fit(mem_fit_worst_tree);
+
+    void* a = mem_alloc(32);
+    UNUSED void* b = mem_alloc(16);
+    void* c = mem_alloc(16);
+    void* d = mem_alloc(40000);
+
+    mem_free(a);
+    mem_free(c);
+
+    // Le plus grand trou est d'abord la fin du tas, puis celui de c, agrandi par la libération de d
+    void* e = mem_alloc(16);
+    assert(e > d);
+    mem_free(d);
+    assert_eq(mem_alloc(512), c);
+}
+
+// Sur une même suite d'opérations, mem_fit_best_tree doit faire exactement les mêmes choix que mem_fit_best
+void fit_tree_same_as_list() {
+    static char memory_tree[65536] __attribute__((aligned(16)));
+    struct mem_heap* list = mem_default_heap();
+    struct mem_heap* tree = mem_heap_create(memory_tree, sizeof(memory_tree), 0);
+    mem_heap_fit(list, mem_fit_best);
+    mem_heap_fit(tree, mem_fit_best_tree);
+
+    void* zones_list[64] = {0};
+    void* zones_tree[64] = {0};
+    unsigned seed = 42;
+    for (int i = 0; i < 5000; i++) {
+        int k = rand_r(&seed) % 64;
+        if (zones_list[k]) {
+            assert(mem_heap_free(list, zones_list[k]));
+            assert(mem_heap_free(tree, zones_tree[k]));
+            zones_list[k] = zones_tree[k] = NULL;
+        } else {
+            size_t size = rand_r(&seed) % 600;
+            zones_list[k] = mem_heap_alloc(list, size);
+            zones_tree[k] = mem_heap_alloc(tree, size);
+            assert_eq(zones_list[k] - (void*) list, zones_tree[k] - (void*) tree);
+        }
+    }
+    mem_heap_destroy(tree);
+}
+
+// Ce que mem_heap_stats doit trouver, recalculé en parcourant la chaîne
+static size_t walk_free, walk_free_zones, walk_largest;
+
+static void walk_zone(UNUSED void* adr, size_t size, int free) {
+    if (free && size > 32) {
+        walk_free += size - 32;
+        walk_free_zones++;
+        walk_largest = size - 32 > walk_largest ? size - 32 : walk_largest;
+    }
+}
+
+// Mémoire consommée par n allocations de size octets
+static size_t consumed(struct mem_heap* heap, size_t n, size_t size, void** zones) {
+    struct mem_stats before, after;
+    mem_heap_stats(heap, &before);
+    for (size_t i = 0; i < n; i++) {
+        zones[i] = mem_heap_alloc(heap, size);
+        assert(zones[i]);
+    }
+    mem_heap_stats(heap, &after);
+    return (after.heap_size - after.free) - (before.heap_size - before.free);
+}
+
+void slabs() {
+    static void* zones[2000];
+    struct mem_heap* plain = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS);
+    struct mem_heap* heap = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS | MEM_SLABS);
+
+    // Sans en-tête par objet, les petits objets prennent environ deux fois moins de place
+    size_t plain_size = consumed(plain, 2000, 24, zones);
+    size_t slab_size = consumed(heap, 2000, 24, zones);
+    assert(slab_size * 10 < plain_size * 6);
+
+    for (size_t i = 0; i < 2000; i++) {
+        assert_eq((size_t) zones[i] % 16, 0);
+        assert_eq(mem_heap_get_size(heap, zones[i]), 32);
+        memset(zones[i], (int) i, 32);
+    }
+    for (size_t i = 0; i < 2000; i++) {
+        assert_eq(*(unsigned char*) zones[i], i & 0xff);
+    }
+
+    // Double libération
+    assert(mem_heap_free(heap, zones[0]));
+    assert(!mem_heap_free(heap, zones[0]));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert_eq(mem_heap_get_size(heap, zones[0]), MEM_GET_SIZE_ERROR);
+    assert(!mem_heap_free(heap, zones[1] + 8));
+    zones[0] = mem_heap_alloc(heap, 17);
+
+    // Dans la même classe, realloc ne déplace pas l'objet, et sinon il garde son contenu
+    assert(mem_heap_realloc(heap, zones[1], 20) == zones[1]);
+    void* moved = mem_heap_realloc(heap, zones[1], 60);
+    assert(moved != zones[1]);
+    assert_eq(mem_heap_get_size(heap, moved), 64);
+    assert_eq(*(unsigned char*) moved, 1);
+    zones[1] = mem_heap_realloc(heap, moved, 200);
+    assert_eq(*(unsigned char*) zones[1], 1);
+
+    // Les slabs vidés sont rendus à la chaîne : il n'en reste qu'un par classe
+    struct mem_stats full, empty;
+    mem_heap_stats(heap, &full);
+    for (size_t i = 0; i < 2000; i++) {
+        assert(mem_heap_free(heap, zones[i]));
+    }
+    mem_heap_stats(heap, &empty);
+    assert_eq(empty.in_use, 0);
+    // Les objets libérés, moins le slab gardé par la classe des 32 octets
+    assert(empty.free - full.free > 2000 * 32 - 4096);
+    assert(empty.heap_size - empty.free < 3 * 4096);
+
+    mem_heap_destroy(plain);
+    mem_heap_destroy(heap);
+}
+
+void pools() {
+    static void* objs[1000];
+    struct mem_heap* heap = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS | MEM_SLABS);
+    struct mem_stats before, st;
+    mem_heap_stats(heap, &before);
+
+    struct mem_pool* pool = mem_heap_pool_create(heap, 40, 64);
+    assert(pool);
+    assert(!mem_heap_pool_create(heap, 40, 48));
+
+    // Les 1000 objets viennent d'un seul bloc
+    assert_eq(mem_pool_get_n(pool, objs, 1000), 1000);
+    mem_heap_stats(heap, &st);
+    assert_eq(st.allocs - before.allocs, 2); // le pool et son bloc
+    for (size_t i = 0; i < 1000; i++) {
+        assert_eq((size_t) objs[i] % 64, 0);
+        if (i) {
+            assert_eq(objs[i] - objs[i - 1], 64);
+        }
+        memset(objs[i], 0xab, 40);
+    }
+
+    // Les objets rendus sont resservis sans nouveau bloc
+    mem_pool_put_n(pool, objs, 1000);
+    void* one = mem_pool_get(pool);
+    assert(one == objs[999]);
+    mem_pool_put(pool, one);
+    assert_eq(mem_pool_get_n(pool, objs, 1000), 1000);
+    mem_heap_stats(heap, &st);
+    assert_eq(st.allocs - before.allocs, 2);
+
+    // Le bloc suivant est plus grand que le minimum
+    assert(mem_pool_get(pool));
+    assert(mem_pool_get_n(pool, objs, 100) == 100);
+    mem_heap_stats(heap, &st);
+    assert_eq(st.allocs - before.allocs, 3);
+
+    mem_pool_destroy(pool);
+    mem_heap_stats(heap, &st);
+    assert_eq(st.in_use, before.in_use);
+    assert_eq(st.frees - before.frees, 3);
+
+    // Petits objets non alignés
+    pool = mem_heap_pool_create(heap, 3, 1);
+    void* a = mem_pool_get(pool);
+    void* b = mem_pool_get(pool);
+    assert_eq(b - a, sizeof(void*));
+    mem_pool_destroy(pool);
+
+    mem_heap_destroy(heap);
+}
+
+void arenas() {
+    struct mem_heap* heap = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS);
+    struct mem_stats before, st;
+    mem_heap_stats(heap, &before);
+    struct mem_arena* arena = mem_heap_arena_create(heap, 0);
+
+    // Les zones se suivent dans le bloc, à l'alignement près
+    char* a = mem_arena_alloc(arena, 10, 1);
+    char* b = mem_arena_alloc(arena, 3, 1);
+    assert(b == a + 10);
+    char* c = mem_arena_alloc(arena, 8, 64);
+    assert_eq((size_t) c % 64, 0);
+    assert(c >= b + 3 && c < b + 3 + 64);
+    assert(!mem_arena_alloc(arena, 8, 24));
+    mem_heap_stats(heap, &st);
+    assert_eq(st.allocs - before.allocs, 2);
+
+    // Beaucoup d'allocations après une marque ouvrent de nouveaux blocs, tous rendus par reset
+    void* mark = mem_arena_mark(arena);
+    struct mem_stats marked;
+    mem_heap_stats(heap, &marked);
+    for (int i = 0; i < 1000; i++) {
+        memset(mem_arena_alloc(arena, 100, 16), i, 100);
+    }
+    char* big = mem_arena_alloc(arena, 100000, 4096);
+    assert_eq((size_t) big % 4096, 0);
+    memset(big, 0, 100000);
+    mem_heap_stats(heap, &st);
+    assert(st.allocs - marked.allocs >= 3);
+    mem_arena_reset(arena, mark);
+    mem_heap_stats(heap, &st);
+    assert_eq(st.in_use, marked.in_use);
+    assert(mem_arena_alloc(arena, 1, 1) == mark);
+
+    // Une remise à zéro complète garde le premier bloc
+    mem_arena_reset(arena, NULL);
+    assert(mem_arena_alloc(arena, 10, 1) == a);
+
+    mem_arena_destroy(arena);
+    mem_heap_stats(heap, &st);
+    assert_eq(st.in_use, before.in_use);
+    mem_heap_destroy(heap);
+}
+
+void aligned_allocations() {
+    unsigned flags[] = {0, MEM_BOUNDARY_TAGS, MEM_GUARDS, MEM_BOUNDARY_TAGS | MEM_SLABS};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        struct mem_heap* heap = mem_heap_create_mmap(0, flags[f]);
+        assert(!mem_heap_alloc_aligned(heap, 10, 48));
+        assert(!mem_heap_alloc_aligned(heap, 10, 0));
+        // Mêmes limites que mem_heap_alloc
+        assert(!mem_heap_alloc_aligned(heap, SIZE_MAX - 8, 64));
+        assert(!mem_heap_alloc_aligned(heap, (size_t) PTRDIFF_MAX + 1, 64));
+        assert(!mem_heap_alloc_aligned(heap, 10, (size_t) 1 << (sizeof(size_t) * 8 - 1)));
+
+        void* zones[40];
+        unsigned seed = 3;
+        for (int i = 0; i < 40; i++) {
+            size_t align = (size_t) 1 << rand_r(&seed) % 13;
+            size_t size = rand_r(&seed) % 300;
+            zones[i] = mem_heap_alloc_aligned(heap, size, align);
+            assert(zones[i]);
+            assert_eq((size_t) zones[i] % align, 0);
+            assert(mem_heap_get_size(heap, zones[i]) >= size);
+            memset(zones[i], i, size);
+        }
+        for (int i = 0; i < 40; i += 2) {
+            assert(mem_heap_free(heap, zones[i]));
+        }
+        // L'espace laissé par l'alignement reste allouable
+        struct mem_stats st;
+        mem_heap_stats(heap, &st);
+        for (int i = 0; i < 40; i += 2) {
+            zones[i] = mem_heap_alloc(heap, 16);
+        }
+        struct mem_stats after;
+        mem_heap_stats(heap, &after);
+        assert_eq(after.heap_size, st.heap_size);
+        for (int i = 0; i < 40; i++) {
+            assert(mem_heap_free(heap, zones[i]));
+        }
+        mem_heap_stats(heap, &st);
+        assert_eq(st.in_use, 0);
+        if (!(flags[f] & MEM_SLABS)) { // le dernier slab de chaque classe est gardé
+            assert_eq(st.free_zones, 1);
+        }
+        mem_heap_destroy(heap);
+    }
+}
+
+static bool all_zero(const unsigned char* p, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (p[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void calloc_zeroes() {
+    struct mem_heap* heap = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS);
+    mem_heap_large_threshold(heap, 0);
+    assert(!mem_heap_calloc(heap, (size_t) -1 / 2, 3));
+
+    // Une zone déjà servie est effacée
+    for (size_t size = 1; size < 5000; size = size * 3 + 1) {
+        void* dirty = mem_heap_alloc(heap, size);
+        memset(dirty, 0xff, size);
+        assert(mem_heap_free(heap, dirty));
+        unsigned char* zone = mem_heap_calloc(heap, size, 1);
+        assert(zone == dirty);
+        assert(all_zero(zone, size));
+        assert(mem_heap_free(heap, zone));
+    }
+
+    // À cheval sur la partie déjà servie et la mémoire neuve
+    unsigned char* dirty = mem_heap_alloc(heap, 1000);
+    memset(dirty, 0xff, 1000);
+    assert(mem_heap_free(heap, dirty));
+    unsigned char* zone = mem_heap_calloc(heap, 100, 1000);
+    assert(zone == dirty && all_zero(zone, 100000));
+
+    // La mémoire neuve n'est pas touchée : ses pages ne sont pas chargées
+    size_t page = sysconf(_SC_PAGESIZE), size = 64 << 20;
+    zone = mem_heap_calloc(heap, 1, size);
+    assert(zone);
+    unsigned char resident[(64 << 20) / 4096];
+    assert(page == 4096 && !mincore((void*) ((size_t) zone & ~(page - 1)), size, resident));
+    size_t loaded = 0;
+    for (size_t i = 0; i < size / page; i++) {
+        loaded += resident[i] & 1;
+    }
+    assert(loaded < 4);
+    assert(all_zero(zone, size));
+    mem_heap_destroy(heap);
+
+    // Dans une mémoire fournie par l'utilisateur, tout est effacé
+    static char memory[8192] __attribute__((aligned(16)));
+    memset(memory, 0xff, sizeof(memory));
+    heap = mem_heap_create(memory, sizeof(memory), 0);
+    zone = mem_heap_calloc(heap, 10, 100);
+    assert(zone && all_zero(zone, 1000));
+}
+
+// Découpes et fusions de zones libres pour des salves d'allocations libérées aussitôt
+static size_t ping_pong_churn(struct mem_heap* heap) {
+    void* zones[100];
+    struct mem_stats before, after;
+    mem_heap_stats(heap, &before);
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < 100; i++) {
+            zones[i] = mem_heap_alloc(heap, 32 + 16 * (i % 8));
+            assert(zones[i]);
+        }
+        for (int i = 0; i < 100; i++) {
+            assert(mem_heap_free(heap, zones[i]));
+        }
+    }
+    mem_heap_stats(heap, &after);
+    return (after.splits - before.splits) + (after.merges - before.merges);
+}
+
+void deferred_frees() {
+    static char memory[16384] __attribute__((aligned(16)));
+    assert(!mem_heap_defer_frees(mem_heap_create(memory, sizeof(memory), 0), 4096));
+
+    struct mem_heap* heap = mem_heap_create(memory, sizeof(memory), MEM_BOUNDARY_TAGS);
+    assert(mem_heap_defer_frees(heap, 4096));
+    void* a = mem_heap_alloc(heap, 64);
+    void* b = mem_heap_alloc(heap, 64);
+    struct mem_stats st, before;
+    mem_heap_stats(heap, &before);
+
+    // Une zone en attente n'est plus allouée, et revient telle quelle à la prochaine allocation de sa taille
+    assert(mem_heap_free(heap, a));
+    assert(!mem_heap_free(heap, a));
+    assert_eq(LAST_ERROR, NOT_ALLOCATED);
+    assert_eq(mem_heap_get_size(heap, a), MEM_GET_SIZE_ERROR);
+    assert(!mem_heap_realloc(heap, a, 10));
+    assert(mem_heap_alloc(heap, 48) != a);
+    assert(mem_heap_alloc(heap, 64) == a);
+    mem_heap_stats(heap, &st);
+    assert_eq(st.merges, before.merges);
+    assert_eq(st.in_use, before.in_use + 48);
+
+    // Au-delà du budget, tout est fusionné
+    mem_heap_free(heap, a);
+    mem_heap_free(heap, b);
+    void* zones[64];
+    for (int i = 0; i < 64; i++) {
+        zones[i] = mem_heap_alloc(heap, 128);
+    }
+    mem_heap_stats(heap, &before);
+    for (int i = 0; i < 32; i++) {
+        assert(mem_heap_free(heap, zones[i]));
+    }
+    mem_heap_stats(heap, &st);
+    assert(st.merges - before.merges >= 32);
+
+    // Une recherche qui échoue fusionne les zones en attente avant d'abandonner
+    for (int i = 32; i < 64; i++) {
+        assert(mem_heap_free(heap, zones[i]));
+    }
+    mem_heap_stats(heap, &st);
+    assert(st.largest_free < 8192);
+    assert(mem_heap_alloc(heap, 8192));
+
+    // Sans le mode différé, une salve redécoupe et refusionne sans cesse les mêmes zones
+    struct mem_heap* eager = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS);
+    struct mem_heap* deferred = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS);
+    mem_heap_defer_frees(deferred, 64 * 1024);
+    size_t eager_churn = ping_pong_churn(eager), deferred_churn = ping_pong_churn(deferred);
+    assert(deferred_churn * 50 < eager_churn);
+
+    // Désactiver le mode fusionne tout
+    mem_heap_defer_frees(deferred, 0);
+    mem_heap_stats(deferred, &st);
+    assert_eq(st.in_use, 0);
+    assert_eq(st.free_zones, 1);
+    mem_heap_destroy(eager);
+    mem_heap_destroy(deferred);
+}
+
+void sized_frees() {
+    unsigned flags[] = {MEM_GUARDS, MEM_BOUNDARY_TAGS | MEM_SLABS, MEM_GUARDS | MEM_SIZE_CHECKS,
+                       MEM_BOUNDARY_TAGS | MEM_SLABS | MEM_SIZE_CHECKS};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        struct mem_heap* heap = mem_heap_create_mmap(0, flags[f]);
+        mem_heap_large_threshold(heap, 16384);
+        size_t sizes[] = {0, 10, 64, 100, 5000, 40000};
+        void* zones[6];
+        for (int i = 0; i < 6; i++) {
+            zones[i] = mem_heap_alloc(heap, sizes[i]);
+        }
+        void* aligned = mem_heap_alloc_aligned(heap, 24, 256);
+
+        // Un pointeur hors du tas qui n'est pas une grande allocation est refusé
+        int on_stack;
+        assert(!mem_heap_free_sized(heap, &on_stack, 16));
+        assert_eq(LAST_ERROR, NOT_ALLOCATED);
+        if (flags[f] & MEM_SIZE_CHECKS) {
+            // La taille est vérifiée, et la zone reste allouée si elle est fausse
+            assert(!mem_heap_free_sized(heap, zones[1], 48));
+            assert_eq(LAST_ERROR, SIZE_MISMATCH);
+            assert(!mem_heap_free_sized(heap, zones[3], 200));
+            assert_eq(LAST_ERROR, SIZE_MISMATCH);
+            assert(!mem_heap_free_sized(heap, zones[4], 4000));
+            assert(!mem_heap_free_sized(heap, zones[5], 50000));
+            assert_eq(LAST_ERROR, SIZE_MISMATCH);
+            assert(!mem_heap_free_sized(heap, zones[5], 30000));
+            assert_eq(LAST_ERROR, SIZE_MISMATCH);
+        }
+        for (int i = 0; i < 6; i++) {
+            assert(mem_heap_free_sized(heap, zones[i], sizes[i]));
+        }
+        assert(mem_heap_free_sized(heap, aligned, 24));
+        assert(!mem_heap_free_sized(heap, zones[3], sizes[3]));
+
+        struct mem_stats st;
+        mem_heap_stats(heap, &st);
+        assert_eq(st.in_use, 0);
+        assert_eq(st.frees, 7);
+        mem_heap_destroy(heap);
+    }
+
+    void* a = mem_alloc(30);
+    assert(mem_free_sized(a, 30));
+    int on_stack;
+    assert(!mem_free_sized(&on_stack, 16));
+}
+
+void batches() {
+    unsigned flags[] = {0, MEM_GUARDS, MEM_BOUNDARY_TAGS, MEM_BOUNDARY_TAGS | MEM_SLABS};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        struct mem_heap* heap = mem_heap_create_mmap(0, flags[f]);
+        mem_heap_large_threshold(heap, 16384);
+        static void* zones[1000];
+        struct mem_stats st, before;
+        mem_heap_stats(heap, &before);
+
+        // Une seule découpe pour toutes les zones qui tiennent dans la même zone libre
+        assert_eq(mem_heap_alloc_batch(heap, 100, 1000, zones), 1000);
+        mem_heap_stats(heap, &st);
+        assert(st.splits - before.splits < 10);
+        assert_eq(st.allocs - before.allocs, 1000);
+        assert_eq(st.in_use, 1000 * 112);
+        for (int i = 0; i < 1000; i++) {
+            assert((size_t) zones[i] % 16 == 0);
+            assert_eq(mem_heap_get_size(heap, zones[i]), 112);
+            memset(zones[i], i, 100);
+        }
+        for (int i = 0; i < 1000; i++) {
+            assert(((unsigned char*) zones[i])[99] == (unsigned char) i);
+        }
+
+        // Libération dans le désordre : tout est refusionné
+        unsigned seed = 3;
+        for (int i = 999; i > 0; i--) {
+            int j = rand_r(&seed) % (i + 1);
+            void* tmp = zones[i];
+            zones[i] = zones[j];
+            zones[j] = tmp;
+        }
+        assert(mem_heap_free_batch(heap, zones, 1000));
+        mem_heap_stats(heap, &st);
+        assert_eq(st.in_use, 0);
+        assert_eq(st.free_zones, 1);
+        assert_eq(st.frees - before.frees, 1000);
+
+        // Lot mélangé : petits objets, grandes allocations, NULL, et des zones invalides qui n'empêchent pas le reste
+        size_t sizes[] = {10, 64, 300, 20000, 1000};
+        for (int i = 0; i < 5; i++) {
+            zones[i] = mem_heap_alloc(heap, sizes[i]);
+        }
+        assert_eq(mem_heap_alloc_batch(heap, 20000, 2, zones + 5), 2);
+        zones[7] = NULL;
+        zones[8] = zones[2];
+        zones[9] = (char*) zones[4] + 16;
+        assert(!mem_heap_free_batch(heap, zones, 10));
+        mem_heap_stats(heap, &st);
+        assert_eq(st.in_use, 0);
+        assert_eq(st.frees - before.frees, 1007);
+        mem_heap_destroy(heap);
+    }
+
+    // Tas plein : on obtient ce qui tient
+    static char memory[16384] __attribute__((aligned(16)));
+    struct mem_heap* heap = mem_heap_create(memory, sizeof(memory), 0);
+    void* zones[100];
+    size_t got = mem_heap_alloc_batch(heap, 1000, 100, zones);
+    assert(got > 10 && got < 16);
+    assert(!mem_heap_alloc(heap, 1000));
+    assert(mem_heap_free_batch(heap, zones, got));
+    assert(mem_heap_alloc(heap, 8192));
+
+    assert_eq(mem_alloc_batch(50, 10, zones), 10);
+    assert(mem_free_batch(zones, 10));
+}
+
+static void wait_child(pid_t child) {
+    int status;
+    assert(child > 0);
+    assert(waitpid(child, &status, 0) == child && WIFEXITED(status));
+    assert_eq(WEXITSTATUS(status), 0);
+}
+
+static void die_holding_lock(UNUSED void* adr, UNUSED size_t size, UNUSED int free) {
+    _exit(0);
+}
+
+void shared_heap() {
+    int fd = memfd_create("shared_heap", MFD_CLOEXEC);
+    assert(fd >= 0);
+    struct mem_heap* heap = mem_heap_create_shared(fd, 1 << 20, MEM_BOUNDARY_TAGS);
+    assert(heap);
+    mem_heap_fit(heap, mem_fit_best_tree);
+    assert(!mem_attach(mem_default_heap()));
+    char** mailbox = mem_heap_calloc(heap, 4, sizeof(char*));
+
+    // Les fils allouent et libèrent en même temps dans le tas, et laissent chacun un message au père
+    pid_t children[4];
+    for (int c = 0; c < 4; c++) {
+        children[c] = fork();
+        if (!children[c]) {
+            void* zones[64] = {0};
+            unsigned seed = c;
+            for (int i = 0; i < 20000; i++) {
+                int j = rand_r(&seed) % 64;
+                if (zones[j] && !mem_heap_free(heap, zones[j])) {
+                    _exit(1);
+                }
+                zones[j] = zones[j] ? NULL : mem_heap_alloc(heap, 16 + rand_r(&seed) % 2000);
+            }
+            if (!mem_heap_free_batch(heap, zones, 64) || !(mailbox[c] = mem_heap_alloc(heap, 32))) {
+                _exit(1);
+            }
+            snprintf(mailbox[c], 32, "fils %d", c);
+            _exit(0);
+        }
+    }
+    for (int c = 0; c < 4; c++) {
+        wait_child(children[c]);
+    }
+    char expected[32];
+    for (int c = 0; c < 4; c++) {
+        snprintf(expected, sizeof(expected), "fils %d", c);
+        assert(!strcmp(mailbox[c], expected));
+        assert(mem_heap_free(heap, mailbox[c]));
+    }
+    struct mem_stats st;
+    mem_heap_stats(heap, &st);
+    assert_eq(st.in_use, 32);
+    assert_eq(st.allocs, st.frees + 1);
+
+    // Un processus qui n'en hérite pas s'attache par le descripteur : le fils garde la projection héritée, pour que la
+    // sienne soit ailleurs, et ne passe que par elle. Les zones se désignent par leur distance au début du tas.
+    size_t mailbox_offset = (void*) mailbox - (void*) heap;
+    pid_t child = fork();
+    if (!child) {
+        struct mem_heap* view = mem_heap_attach(fd);
+        char* zone;
+        if (!view || view == heap || !mem_attach(view) || !(zone = mem_alloc(100))) {
+            _exit(1);
+        }
+        strcpy(zone, "attaché");
+        *(size_t*) ((void*) view + mailbox_offset) = (void*) zone - (void*) view;
+        _exit(0);
+    }
+    wait_child(child);
+    char* attached = (void*) heap + *(size_t*) mailbox;
+    assert(!strcmp(attached, "attaché"));
+    assert(mem_heap_free(heap, attached));
+
+    // Deux projections dans le même processus partagent aussi tout, verrou compris
+    struct mem_heap* view = mem_heap_attach(fd);
+    assert(view && view != heap);
+    char* zone = mem_heap_alloc(view, 64);
+    assert(zone > (char*) view && zone < (char*) view + (1 << 20));
+    assert(mem_heap_free(heap, (void*) heap + (zone - (char*) view)));
+    mem_heap_stats(view, &st);
+    assert_eq(st.in_use, 32);
+    mem_heap_destroy(view);
+    // Un fichier quelconque n'est pas un tas
+    int other = memfd_create("other", MFD_CLOEXEC);
+    assert(other >= 0 && !ftruncate(other, 1 << 20));
+    assert(!mem_heap_attach(other));
+    close(other);
+
+    // Ni pools ni arènes, dont les liens et l'état ne sont pas partagés
+    assert(!mem_heap_pool_create(heap, 32, 8));
+    assert(!mem_heap_arena_create(heap, 0));
+
+    // Pas de grandes allocations hors du tas, et les pages libres sont vraiment rendues
+    mem_heap_large_threshold(heap, 4096);
+    zone = mem_heap_alloc(heap, 100000);
+    assert((void*) zone > (void*) heap && (void*) zone < (void*) heap + (1 << 20));
+    assert(mem_heap_free(heap, zone));
+    assert(mem_heap_trim(heap) > 0);
+
+    // Un fils meurt en tenant le verrou (mem_heap_show le garde pendant les appels à print) : le tas, peut-être à moitié
+    // modifié, est empoisonné et refuse toute opération
+    child = fork();
+    if (!child) {
+        mem_heap_show(heap, die_holding_lock);
+        _exit(1);
+    }
+    wait_child(child);
+    assert(!mem_heap_alloc(heap, 1000));
+    assert_eq(LAST_ERROR, HEAP_POISONED);
+    assert(!mem_heap_free(heap, mailbox));
+    assert_eq(LAST_ERROR, HEAP_POISONED);
+
+    mem_heap_destroy(heap);
+    close(fd);
+}
+
+void stats() {
+    mem_fit_function_t* fits[] = {mem_fit_first, mem_fit_segregated, mem_fit_best_tree};
+    for (size_t f = 0; f < sizeof(fits) / sizeof(fits[0]); f++) {
+        struct mem_heap* heap = mem_heap_create_mmap(0, MEM_BOUNDARY_TAGS);
+        mem_heap_fit(heap, fits[f]);
+        mem_heap_large_threshold(heap, 16384);
+
+        void* zones[64] = {0};
+        size_t sizes[64] = {0};
+        size_t in_use = 0, allocs = 0, frees = 0;
+        unsigned seed = 7;
+        for (int i = 0; i < 3000; i++) {
+            int k = rand_r(&seed) % 64;
+            size_t size = rand_r(&seed) % 4 ? rand_r(&seed) % 600 : rand_r(&seed) % 40000;
+            if (!zones[k]) {
+                zones[k] = mem_heap_alloc(heap, size);
+                assert(zones[k]);
+                allocs++;
+            } else if (rand_r(&seed) % 3) {
+                assert(mem_heap_free(heap, zones[k]));
+                zones[k] = NULL;
+                size = 0;
+                frees++;
+            } else {
+                // Une grande allocation agrandie par mremap n'est ni une allocation ni une libération : on les évite
+                size %= 600;
+                void* moved = mem_heap_realloc(heap, zones[k], size);
+                assert(moved);
+                if (moved != zones[k]) {
+                    allocs++;
+                    frees++;
+                }
+                zones[k] = moved;
+            }
+            in_use -= sizes[k];
+            sizes[k] = zones[k] ? mem_heap_get_size(heap, zones[k]) : 0;
+            in_use += sizes[k];
+
+            struct mem_stats st;
+            mem_heap_stats(heap, &st);
+            walk_free = walk_free_zones = walk_largest = 0;
+            mem_heap_show(heap, walk_zone);
+            assert_eq(st.in_use, in_use);
+            assert_eq(st.free, walk_free);
+            assert_eq(st.free_zones, walk_free_zones);
+            assert_eq(st.largest_free, walk_largest);
+            assert_eq(st.allocs, allocs);
+            assert_eq(st.frees, frees);
+            assert_eq(st.failed, 0);
+            assert_eq(st.heap_size, mem_heap_memory_size(heap));
+            assert(st.average_search >= 1);
+        }
+        mem_heap_destroy(heap);
+    }
+
+    // Les échecs sont comptés, et la fragmentation se lit sur les zones libres
+    struct mem_stats st;
+    void* a = mem_alloc(1000);
+    void* b = mem_alloc(1000);
+    mem_alloc(1000);
+    assert(!mem_alloc(get_memory_size()));
+    mem_free(a);
+    mem_stats(&st);
+    assert_eq(st.failed, 1);
+    assert(st.fragmentation > 0 && st.fragmentation < 0.5);
+    mem_free(b);
+    mem_stats(&st);
+    assert_eq(st.free_zones, 2);
+    assert_eq(st.frees, 2);
+}
+
+// Nombre de lignes du profil, donc d'échantillons vivants
+static int profile_lines() {
+    FILE* f = tmpfile();
+    assert(f);
+    assert(mem_profile_dump(fileno(f)));
+    rewind(f);
+    int lines = 0, c;
+    size_t last_weight = 0;
+    while ((c = fgetc(f)) != EOF) {
+        if (c == ' ') {
+            assert(fscanf(f, "%zu", &last_weight) == 1);
+            assert(last_weight >= 64);
+        } else if (c == '\n') {
+            lines++;
+        }
+    }
+    fclose(f);
+    return lines;
+}
+
+void profile() {
+    // Avec une période d'un octet, toutes les allocations sont échantillonnées
+    assert(mem_profile_start(1));
+    void* a = mem_alloc(64);
+    void* b = mem_alloc(64);
+    assert_eq(profile_lines(), 2);
+    mem_free(a);
+    assert_eq(profile_lines(), 1);
+
+    // Les échantillons d'un tas détruit disparaissent avec lui
+    static char memory[4096] __attribute__((aligned(16)));
+    struct mem_heap* heap = mem_heap_create(memory, sizeof(memory), 0);
+    mem_heap_alloc(heap, 64);
+    mem_heap_alloc(heap, 64);
+    assert_eq(profile_lines(), 3);
+    mem_heap_destroy(heap);
+    assert_eq(profile_lines(), 1);
+
+    // Avec une grande période, seule une petite partie des allocations l'est
+    assert(mem_profile_start(1 << 20));
+    void* zones[1000];
+    for (int i = 0; i < 1000; i++) {
+        zones[i] = mem_alloc(64);
+    }
+    assert(profile_lines() < 10);
+    for (int i = 0; i < 1000; i++) {
+        mem_free(zones[i]);
+    }
+    mem_free(b);
+    assert_eq(profile_lines(), 0);
+
+    mem_profile_stop();
+    mem_alloc(64);
+    assert_eq(profile_lines(), 0);
+}
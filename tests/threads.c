@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../malloc_stub.h"
+
+/**
+ * Plusieurs threads allouent et libèrent en même temps via malloc_stub.c, chacun vérifiant que ses zones ne sont pas
+ * écrasées par les autres. Pendant ce temps, le thread principal fait des fork : le fils doit pouvoir allouer.
+ */
+
+#define NB_THREADS 8
+#define NB_ITERATIONS 20000
+#define NB_ZONES 16
+
+static void *worker(void *arg) {
+    unsigned char id = (unsigned char) (uintptr_t) arg;
+    unsigned seed = id;
+    unsigned char *zones[NB_ZONES] = {0};
+    size_t sizes[NB_ZONES] = {0};
+    size_t alignments[NB_ZONES] = {0}; // 0 pour une zone de malloc ou realloc
+
+    for (int i = 0; i < NB_ITERATIONS; i++) {
+        int k = rand_r(&seed) % NB_ZONES;
+        if (zones[k]) {
+            for (size_t j = 0; j < sizes[k]; j++) {
+                assert(zones[k][j] == id);
+            }
+            if (rand_r(&seed) % 4 == 0) {
+                // realloc doit conserver le contenu, sur place ou non
+                size_t kept = sizes[k];
+                sizes[k] = 1 + rand_r(&seed) % 400;
+                kept = kept < sizes[k] ? kept : sizes[k];
+                zones[k] = realloc(zones[k], sizes[k]);
+                alignments[k] = 0;
+                assert(zones[k]);
+                for (size_t j = 0; j < kept; j++) {
+                    assert(zones[k][j] == id);
+                }
+                memset(zones[k], id, sizes[k]);
+                continue;
+            }
+            // Une libération sur deux donne la taille
+            if (rand_r(&seed) % 2) {
+                free(zones[k]);
+            } else if (alignments[k]) {
+                free_aligned_sized(zones[k], alignments[k], sizes[k]);
+            } else {
+                free_sized(zones[k], sizes[k]);
+            }
+            zones[k] = NULL;
+        } else {
+            sizes[k] = 1 + rand_r(&seed) % 200;
+            alignments[k] = 0;
+            if (rand_r(&seed) % 8 == 0) {
+                alignments[k] = (size_t) 32 << rand_r(&seed) % 4;
+                assert(posix_memalign((void **) &zones[k], alignments[k], sizes[k]) == 0);
+                assert((uintptr_t) zones[k] % alignments[k] == 0);
+            } else {
+                zones[k] = malloc(sizes[k]);
+            }
+            assert(zones[k]);
+            memset(zones[k], id, sizes[k]);
+        }
+    }
+    for (int k = 0; k < NB_ZONES; k++) {
+        free(zones[k]);
+    }
+    return NULL;
+}
+
+// Le reste de l'interface de la glibc
+static void extensions() {
+    char *p = malloc(20);
+    assert(malloc_usable_size(p) >= 20);
+    assert(malloc_usable_size(NULL) == 0);
+    p = reallocarray(p, 10, 30);
+    assert(p && malloc_usable_size(p) >= 300);
+    volatile size_t too_many = SIZE_MAX / 2; // pour que le compilateur ne voie pas le dépassement
+    errno = 0;
+    assert(!reallocarray(p, too_many, 3) && errno == ENOMEM);
+    volatile size_t too_big = SIZE_MAX;
+    errno = 0;
+    assert(!realloc(p, too_big) && errno == ENOMEM);
+    // Toutes les allocations démesurées échouent avec ENOMEM, sans déborder en arrondissant la taille
+    size_t huge_sizes[] = {SIZE_MAX, SIZE_MAX - 8, SIZE_MAX - 20, SIZE_MAX - 4096, SIZE_MAX / 2 + 1};
+    for (size_t i = 0; i < sizeof(huge_sizes) / sizeof(huge_sizes[0]); i++) {
+        too_big = huge_sizes[i];
+        errno = 0;
+        assert(!malloc(too_big) && errno == ENOMEM);
+        errno = 0;
+        assert(!calloc(1, too_big) && errno == ENOMEM);
+        errno = 0;
+        assert(!aligned_alloc(64, too_big) && errno == ENOMEM);
+        errno = 0;
+        assert(!memalign(64, too_big) && errno == ENOMEM);
+        errno = 0;
+        assert(!valloc(too_big) && errno == ENOMEM);
+        errno = 0;
+        assert(!pvalloc(too_big) && errno == ENOMEM);
+        void *q;
+        errno = 0;
+        assert(posix_memalign(&q, 64, too_big) == ENOMEM && errno == 0);
+    }
+    assert(malloc_usable_size(p) >= 300);
+    free(p);
+
+    p = pvalloc(100);
+    assert(p && (uintptr_t) p % sysconf(_SC_PAGESIZE) == 0);
+    assert(malloc_usable_size(p) >= (size_t) sysconf(_SC_PAGESIZE));
+    struct mallinfo2 info = mallinfo2();
+    assert(info.uordblks >= malloc_usable_size(p) && info.arena >= info.uordblks + info.fordblks);
+    free(p);
+
+    p = calloc(1, 1 << 20);
+    free_sized(p, 1 << 20);
+    free_sized(NULL, 0);
+    malloc_trim(0);
+}
+
+int main() {
+    assert(malloc_info3 == malloc);
+    extensions();
+
+    pthread_t threads[NB_THREADS];
+    for (uintptr_t i = 0; i < NB_THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, worker, (void *) (i + 1)) == 0);
+    }
+    for (int i = 0; i < 20; i++) {
+        pid_t child = fork();
+        assert(child >= 0);
+        if (!child) {
+            void *p = malloc(1000);
+            free(malloc(10));
+            free(p);
+            _exit(p ? 0 : 1);
+        }
+        int status;
+        assert(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    for (int i = 0; i < NB_THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    fprintf(stderr, "\033[0;32m✓\033[0m %d threads\n", NB_THREADS);
+}
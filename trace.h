@@ -0,0 +1,40 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+#include <stdint.h>
+
+/* Format des traces binaires écrites par malloc_stub.c quand la variable d'environnement MEM_TRACE est définie, et
+ * lues par bench/trace_decode.c.
+ *
+ * Le fichier commence par un struct trace_file_header, suivi d'enregistrements de taille fixe. Les enregistrements
+ * d'un même thread sont dans l'ordre, mais ceux de threads différents sont mélangés par lots : il faut les trier par
+ * date pour retrouver l'ordre global.
+ */
+
+#define TRACE_MAGIC "MEMTRACE"
+#define TRACE_VERSION 1
+
+enum trace_op {
+    TRACE_MALLOC,
+    TRACE_CALLOC,
+    TRACE_REALLOC,
+    TRACE_FREE,
+};
+
+struct trace_file_header {
+    char magic[8];          // TRACE_MAGIC, sans le zéro final
+    uint32_t version;       // TRACE_VERSION
+    uint32_t record_size;   // sizeof(struct trace_record)
+};
+
+struct trace_record {
+    uint64_t time;      // en nanosecondes (CLOCK_MONOTONIC) ; prise avant une libération, après une allocation
+    uint64_t ptr;       // zone renvoyée (NULL si échec), ou zone libérée
+    uint64_t old;       // realloc : zone d'origine
+    uint64_t size;      // taille demandée (count * size pour calloc)
+    uint32_t callsite;  // hachage de l'adresse de l'appelant, 0 si MEM_TRACE_CALLSITE n'est pas activé
+    uint16_t thread;    // numéro du thread dans la trace
+    uint8_t op;         // enum trace_op
+    uint8_t unused;
+};
+
+#endif